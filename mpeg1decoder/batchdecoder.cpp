@@ -0,0 +1,405 @@
+#include "batchdecoder.h"
+#include "decoder.h"
+#include "executor.h"
+#include "inputbitstream.h"
+#include "startcodes.h"
+#include "videopicture.h"
+#include "videorenderer.h"
+
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include <string.h>
+
+namespace Mpeg1
+{
+	/// Presents one segment of the stream as a complete stream of its own.
+	///
+	/// The segment is read behind a copy of its sequence header and terminated with a sequence end
+	/// code. It is read from the input as the decoder asks for it, so a segment only takes the
+	/// memory of its bitstream buffer however long it is. The input is shared by every segment and
+	/// is only ever accessed with the given mutex held.
+	class SegmentDevice : public QIODevice
+	{
+	public:
+		SegmentDevice(QIODevice *input, QMutex *inputMutex, const QByteArray &header, qint64 begin, qint64 end) :
+			m_input(input),
+			m_inputMutex(inputMutex),
+			m_header(header),
+			m_begin(begin),
+			m_end(end)
+		{
+		}
+
+		bool open(OpenMode mode)
+		{
+			// Reads go straight to readData(), which works out where they are from pos()
+			return QIODevice::open(mode | QIODevice::Unbuffered);
+		}
+
+		bool isSequential() const
+		{
+			return false;
+		}
+
+		qint64 size() const
+		{
+			return m_header.size() + (m_end - m_begin) + sizeof(s_sequenceEndCode);
+		}
+
+	protected:
+		qint64 readData(char *data, qint64 maxSize)
+		{
+			qint64 position = pos();
+			qint64 segmentSize = m_end - m_begin;
+			qint64 length = 0;
+
+			if(position < m_header.size())
+			{
+				length = qMin(maxSize, m_header.size() - position);
+				memcpy(data, m_header.constData() + position, length);
+			}
+
+			qint64 offset = position + length - m_header.size();
+			if(length < maxSize && offset < segmentSize)
+			{
+				qint64 wanted = qMin(maxSize - length, segmentSize - offset);
+
+				QMutexLocker locker(m_inputMutex);
+				if(!m_input->seek(m_begin + offset))
+					return length > 0 ? length : -1;
+
+				qint64 read = m_input->read(data + length, wanted);
+				if(read < 0)
+					return length > 0 ? length : -1;
+
+				length += read;
+				if(read < wanted)
+					return length;
+			}
+
+			offset = position + length - m_header.size() - segmentSize;
+			if(length < maxSize && offset >= 0 && offset < (qint64) sizeof(s_sequenceEndCode))
+			{
+				qint64 tail = qMin(maxSize - length, (qint64) sizeof(s_sequenceEndCode) - offset);
+				memcpy(data + length, s_sequenceEndCode + offset, tail);
+				length += tail;
+			}
+
+			return length;
+		}
+
+		qint64 writeData(const char * /*data*/, qint64 /*maxSize*/)
+		{
+			return -1;
+		}
+
+	private:
+		static const char s_sequenceEndCode[4];
+
+		QIODevice *m_input;
+		QMutex *m_inputMutex;
+		QByteArray m_header;
+		qint64 m_begin;
+		qint64 m_end;
+	};
+
+	const char SegmentDevice::s_sequenceEndCode[4] = { 0x00, 0x00, 0x01, (char) 0xb7 };
+
+	/// Decodes one segment of the stream on a worker thread.
+	///
+	/// The job is the renderer of its own Decoder. It keeps a reference to every picture it is given
+	/// so they can be handed over to the thread delivering them, and it keeps the Decoder (and so the
+	/// picture pool) alive until every one of those pictures has been released. At most the given
+	/// number of pictures wait to be taken; beyond that the decoder waits for the delivery to catch up.
+	class SegmentJob : public QRunnable, public VideoRenderer
+	{
+	public:
+		SegmentJob(SegmentDevice *device, int maximumPictures) :
+			m_device(device),
+			m_input(0),
+			m_decoder(0),
+			m_maximumPictures(maximumPictures),
+			m_width(0),
+			m_height(0),
+			m_pixelAspectRatio(0),
+			m_pictureRate(0),
+			m_bitRate(0),
+			m_done(false)
+		{
+			setAutoDelete(false);
+		}
+
+		~SegmentJob()
+		{
+			while(!m_pictures.isEmpty())
+				m_pictures.takeFirst()->release();
+
+			delete m_decoder;
+			delete m_input;
+			delete m_device;
+		}
+
+		void run()
+		{
+			m_device->open(QIODevice::ReadOnly);
+			m_input = new InputBitstream(m_device);
+
+			// The batch decoder already keeps every core busy, so the decoder runs on this thread
+			m_decoder = new Decoder(0, m_input, this);
+			m_decoder->start();
+
+			QMutexLocker locker(&m_mutex);
+			m_done = true;
+			m_changed.wakeAll();
+		}
+
+		/// Returns the next picture of the segment with a reference held by the caller, waiting for
+		/// it to be decoded if necessary. Returns 0 once the whole segment has been delivered.
+		const VideoPicture *takePicture()
+		{
+			QMutexLocker locker(&m_mutex);
+			while(m_pictures.isEmpty() && !m_done)
+				m_changed.wait(&m_mutex);
+
+			if(m_pictures.isEmpty())
+				return 0;
+
+			m_changed.wakeAll();
+			return m_pictures.takeFirst();
+		}
+
+		void setSize(int width, int height)
+		{
+			QMutexLocker locker(&m_mutex);
+			m_width = width;
+			m_height = height;
+		}
+
+		void pushPicture(const VideoPicture *picture, int /*type*/)
+		{
+			picture->ref();
+
+			QMutexLocker locker(&m_mutex);
+			while(m_pictures.count() >= m_maximumPictures)
+				m_changed.wait(&m_mutex);
+
+			m_pictures.append(picture);
+			m_changed.wakeAll();
+		}
+
+		void setPixelAspectRatio(int aspectRatio)
+		{
+			QMutexLocker locker(&m_mutex);
+			m_pixelAspectRatio = aspectRatio;
+		}
+
+		void setPictureRate(int pictureRate)
+		{
+			QMutexLocker locker(&m_mutex);
+			m_pictureRate = pictureRate;
+		}
+
+		void setBitRate(int bitRate)
+		{
+			QMutexLocker locker(&m_mutex);
+			m_bitRate = bitRate;
+		}
+
+		/// Returns the stream parameters reported by the segment's sequence header. Only valid once
+		/// the first picture has been taken.
+		void parameters(int &width, int &height, int &pixelAspectRatio, int &pictureRate, int &bitRate)
+		{
+			QMutexLocker locker(&m_mutex);
+			width = m_width;
+			height = m_height;
+			pixelAspectRatio = m_pixelAspectRatio;
+			pictureRate = m_pictureRate;
+			bitRate = m_bitRate;
+		}
+
+	private:
+		SegmentDevice *m_device;
+		InputBitstream *m_input;
+		Decoder *m_decoder;
+
+		QMutex m_mutex;
+		QWaitCondition m_changed;
+		QList<const VideoPicture *> m_pictures;
+		int m_maximumPictures;
+
+		int m_width;
+		int m_height;
+		int m_pixelAspectRatio;
+		int m_pictureRate;
+		int m_bitRate;
+		bool m_done;
+	};
+
+	BatchDecoder::BatchDecoder(QIODevice *input, VideoRenderer *renderer) :
+		m_input(input),
+		m_renderer(renderer),
+		m_workers(0),
+		m_width(-1),
+		m_height(-1),
+		m_pixelAspectRatio(-1),
+		m_pictureRate(-1),
+		m_bitRate(-1)
+	{
+		setThreadCount(QThread::idealThreadCount());
+	}
+
+	BatchDecoder::~BatchDecoder()
+	{
+		delete m_workers;
+	}
+
+	void BatchDecoder::setThreadCount(int threadCount)
+	{
+		delete m_workers;
+
+		m_workers = new QThreadPool;
+		m_workers->setMaxThreadCount(qMax(threadCount, 1));
+	}
+
+	int BatchDecoder::threadCount() const
+	{
+		return m_workers->maxThreadCount();
+	}
+
+	bool BatchDecoder::start()
+	{
+		// The index of a large file is scanned in chunks on the cores
+		if(!m_index.build(m_input, Executor::globalInstance()))
+			return false;
+
+		findSegments();
+
+		// Keep one segment queued behind the running ones so a worker never waits on the reader
+		int maximumInFlight = m_workers->maxThreadCount() + 1;
+
+		QList<SegmentJob *> inFlight;
+		int next = 0;
+
+		while(next < m_segments.count() || !inFlight.isEmpty())
+		{
+			while(next < m_segments.count() && inFlight.count() < maximumInFlight)
+			{
+				SegmentJob *job = createJob(m_segments.at(next++));
+				inFlight.append(job);
+				m_workers->start(job);
+			}
+
+			// Reordering stage : segments are delivered in stream order as their pictures appear
+			SegmentJob *job = inFlight.takeFirst();
+			deliver(job);
+			delete job;
+		}
+
+		return true;
+	}
+
+	/// Cuts the stream in front of every closed group of pictures. A sequence header immediately
+	/// preceding a closed GOP belongs to the segment that follows it.
+	void BatchDecoder::findSegments()
+	{
+		m_segments.clear();
+
+		for(int i = 0; i < m_index.count(); i++)
+		{
+			const StartCodeIndex::Entry &entry = m_index.at(i);
+
+			if(entry.code == StartCodes::SequenceEndCode && !m_segments.isEmpty())
+				m_segments.last().end = entry.offset;
+
+			if(entry.code != StartCodes::GroupStartCode)
+				continue;
+
+			if(!m_segments.isEmpty() && !entry.closedGop)
+				continue;
+
+			int sequenceHeader = m_index.sequenceHeaderFor(i);
+			if(sequenceHeader < 0)
+				continue;
+
+			if(!m_segments.isEmpty())
+			{
+				bool headerFirst = m_index.at(i - 1).code == StartCodes::SequenceHeaderCode;
+				m_segments.last().end = headerFirst ? m_index.at(i - 1).offset : entry.offset;
+			}
+
+			Segment segment;
+			segment.sequenceHeader = sequenceHeader;
+			segment.begin = entry.offset;
+			segment.end = m_index.streamSize();
+			m_segments.append(segment);
+		}
+	}
+
+	/// Creates the job decoding a segment. Only the sequence header in effect is read up front; the
+	/// segment itself is read by the job as it decodes.
+	SegmentJob *BatchDecoder::createJob(const Segment &segment)
+	{
+		qint64 headerBegin = m_index.at(segment.sequenceHeader).offset;
+		qint64 headerEnd = m_index.endOffset(segment.sequenceHeader);
+
+		QByteArray header;
+		{
+			// The jobs already started read from the input too
+			QMutexLocker locker(&m_inputMutex);
+
+			m_input->seek(headerBegin);
+			header = m_input->read(headerEnd - headerBegin);
+		}
+
+		// A few pictures per segment let the workers run ahead of the delivery
+		return new SegmentJob(new SegmentDevice(m_input, &m_inputMutex, header, segment.begin, segment.end), 4);
+	}
+
+	void BatchDecoder::deliver(SegmentJob *job)
+	{
+		bool first = true;
+
+		while(const VideoPicture *picture = job->takePicture())
+		{
+			if(first)
+			{
+				int width, height, pixelAspectRatio, pictureRate, bitRate;
+				job->parameters(width, height, pixelAspectRatio, pictureRate, bitRate);
+
+				if(width != m_width || height != m_height)
+					m_renderer->setSize(width, height);
+				if(pixelAspectRatio != m_pixelAspectRatio)
+					m_renderer->setPixelAspectRatio(pixelAspectRatio);
+				if(pictureRate != m_pictureRate)
+					m_renderer->setPictureRate(pictureRate);
+				if(bitRate != m_bitRate)
+					m_renderer->setBitRate(bitRate);
+
+				m_width = width;
+				m_height = height;
+				m_pixelAspectRatio = pixelAspectRatio;
+				m_pictureRate = pictureRate;
+				m_bitRate = bitRate;
+
+				first = false;
+			}
+
+			// Written into the renderer's own buffer if it offers one, as Decoder does
+			VideoBuffer buffer;
+			if(m_renderer->acquireBuffer(picture, picture->pictureType(), buffer))
+			{
+				buffer.write(*picture, QSize(m_width, m_height));
+				m_renderer->pushBuffer(buffer, picture->pictureType());
+			}
+			else
+				m_renderer->pushPicture(picture, picture->pictureType());
+
+			picture->release();
+		}
+	}
+}
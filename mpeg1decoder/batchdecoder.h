@@ -0,0 +1,79 @@
+#if !defined(MPEG1_BATCHDECODER_H)
+#define MPEG1_BATCHDECODER_H
+
+#include <QtCore/QIODevice>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+#include "startcodeindex.h"
+
+namespace Mpeg1
+{
+	/// Decodes a complete stream as fast as possible by decoding independent segments in parallel.
+	///
+	/// A closed group of pictures does not reference any picture before it, so the stream can be
+	/// cut in front of every closed GOP into segments which decode independently. The segments are
+	/// found with a StartCodeIndex, each one is decoded on a worker thread by its own Decoder with
+	/// its own picture store, and the pictures are sent to the renderer in display order from the
+	/// thread calling start(), exactly as Decoder would have sent them.
+	///
+	/// Segments are read from the input as they are decoded and each one keeps only a few decoded
+	/// pictures waiting for delivery, so memory use does not grow with the length of the segments.
+	///
+	/// Streams without closed GOPs form a single segment and decode at the speed of a Decoder.
+	class BatchDecoder
+	{
+	public:
+		/// Constructs the batch decoder
+		///
+		/// \param input the complete video bitstream. Must be random access.
+		/// \param renderer receives the decoded pictures
+		BatchDecoder(QIODevice *input, class VideoRenderer *renderer);
+
+		~BatchDecoder();
+
+		/// Sets the number of segments decoded at the same time. The default is the number of cores.
+		void setThreadCount(int threadCount);
+
+		/// Returns the number of segments decoded at the same time
+		int threadCount() const;
+
+		/// Decodes the whole stream, returning once every picture has been sent to the renderer.
+		///
+		/// \return false if the input could not be indexed
+		bool start();
+
+	private:
+		/// A range of the stream which can be decoded on its own
+		struct Segment
+		{
+			int sequenceHeader;			//< Index entry of the sequence header in effect
+			qint64 begin;
+			qint64 end;
+		};
+
+		void findSegments();
+
+		class SegmentJob *createJob(const Segment &segment);
+
+		void deliver(class SegmentJob *job);
+
+	private:
+		QIODevice *m_input;
+		QMutex m_inputMutex;				//< Held by whoever seeks and reads m_input
+		class VideoRenderer *m_renderer;
+		class QThreadPool *m_workers;
+
+		StartCodeIndex m_index;
+		QList<Segment> m_segments;
+
+		// Last stream parameters given to the renderer
+		int m_width;
+		int m_height;
+		int m_pixelAspectRatio;
+		int m_pictureRate;
+		int m_bitRate;
+	};
+}
+
+#endif
@@ -0,0 +1,344 @@
+#include "colorconverter.h"
+#include "videopicture.h"
+
+#include "utility.h"
+
+#include <QtCore/QVector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MPEG1_COLORCONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Mpeg1
+{
+	// Coefficients in 16 bit fixed point
+	static const int C1 = 0x166E9;  // 1.402 * 2^16
+	static const int C2 = 0x5819;   // 0.34414 * 2^16
+	static const int C3 = 0xB6D1;   // 0.71414 * 2^16
+	static const int C4 = 0x1C5A1;  // 1.772 * 2^16
+
+	static inline int sample(qreal value)
+	{
+		return clip255((int)(value + 0.5));
+	}
+
+	/// Writes one pixel in the requested format
+	static inline void storePixel(uchar *out, int red, int green, int blue, ColorConverter::PixelFormat format)
+	{
+		switch(format)
+		{
+		case ColorConverter::FormatRgb32:
+			*(quint32 *) out = 0xff000000u | (red << 16) | (green << 8) | blue;
+			break;
+
+		case ColorConverter::FormatBgra:
+			out[0] = (uchar) blue;
+			out[1] = (uchar) green;
+			out[2] = (uchar) red;
+			out[3] = 0xff;
+			break;
+
+		case ColorConverter::FormatRgba:
+			out[0] = (uchar) red;
+			out[1] = (uchar) green;
+			out[2] = (uchar) blue;
+			out[3] = 0xff;
+			break;
+		}
+	}
+
+	static inline void convertPixel(uchar *out, qreal luma, int redCr, int greenCbCr, int blueCb, ColorConverter::PixelFormat format)
+	{
+		// Rounded to the nearest, as the SSE2 path does
+		int y = (sample(luma) << 16) + (1 << 15);
+
+		storePixel(out, clip255((y + redCr) >> 16), clip255((y - greenCbCr) >> 16), clip255((y + blueCb) >> 16), format);
+	}
+
+#if defined(MPEG1_COLORCONVERTER_SSE2)
+	// The same coefficients for _mm_mulhi_epi16, which can only multiply by less than 0.5
+	static const short K1 = 26345;	// 1.402 - 1
+	static const short K2 = 22554;	// 0.34414
+	static const short K3 = 18734;	// 1 - 0.71414
+	static const short K4 = 14942;	// 2 - 1.772
+
+	// Samples carry 6 bits of fraction through the calculation
+	static const int FractionBits = 6;
+
+	/// Loads eight samples, rounded and clamped to 0 - 255, into 16 bit lanes
+	static inline __m128i loadSamples(const qreal *in)
+	{
+		__m128i first = _mm_unpacklo_epi64(_mm_cvtpd_epi32(_mm_loadu_pd(in)), _mm_cvtpd_epi32(_mm_loadu_pd(in + 2)));
+		__m128i second = _mm_unpacklo_epi64(_mm_cvtpd_epi32(_mm_loadu_pd(in + 4)), _mm_cvtpd_epi32(_mm_loadu_pd(in + 6)));
+
+		__m128i samples = _mm_packs_epi32(first, second);
+		return _mm_min_epi16(_mm_max_epi16(samples, _mm_setzero_si128()), _mm_set1_epi16(255));
+	}
+
+	/// Loads four chroma samples, centered on 0 and each repeated for the two pixels it covers
+	static inline __m128i loadChroma(const qreal *in)
+	{
+		__m128i samples = _mm_unpacklo_epi64(_mm_cvtpd_epi32(_mm_loadu_pd(in)), _mm_cvtpd_epi32(_mm_loadu_pd(in + 2)));
+		samples = _mm_packs_epi32(samples, samples);
+		samples = _mm_min_epi16(_mm_max_epi16(samples, _mm_setzero_si128()), _mm_set1_epi16(255));
+		samples = _mm_sub_epi16(samples, _mm_set1_epi16(128));
+
+		return _mm_slli_epi16(_mm_unpacklo_epi16(samples, samples), FractionBits);
+	}
+
+	/// Converts one line of eight pixels given their chroma contribution and packs them
+	static inline void convertPixels8(uchar *out, const qreal *lumaIn, __m128i redCr, __m128i greenCbCr, __m128i blueCb, ColorConverter::PixelFormat format)
+	{
+		__m128i rounding = _mm_set1_epi16(1 << (FractionBits - 1));
+		__m128i y = _mm_add_epi16(_mm_slli_epi16(loadSamples(lumaIn), FractionBits), rounding);
+
+		__m128i red = _mm_srai_epi16(_mm_adds_epi16(y, redCr), FractionBits);
+		__m128i green = _mm_srai_epi16(_mm_subs_epi16(y, greenCbCr), FractionBits);
+		__m128i blue = _mm_srai_epi16(_mm_adds_epi16(y, blueCb), FractionBits);
+
+		red = _mm_packus_epi16(red, red);
+		green = _mm_packus_epi16(green, green);
+		blue = _mm_packus_epi16(blue, blue);
+
+		// Native 0xffRRGGBB words are B, G, R, A bytes on x86
+		if(format == ColorConverter::FormatRgba)
+		{
+			__m128i swap = red;
+			red = blue;
+			blue = swap;
+		}
+
+		__m128i first = _mm_unpacklo_epi8(blue, green);
+		__m128i second = _mm_unpacklo_epi8(red, _mm_set1_epi8((char) 0xff));
+
+		_mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(first, second));
+		_mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi16(first, second));
+	}
+#endif
+
+	void ColorConverter::convert(const VideoPicture &picture, const QSize &size, uchar *destination, int stride, PixelFormat format, int firstLine, int lineCount)
+	{
+		int width = qMin(size.width(), picture.luma().size().width());
+		int height = qMin(size.height(), picture.luma().size().height());
+
+		if(lineCount >= 0)
+			height = qMin(height, firstLine + lineCount);
+
+		for(int y = firstLine & ~1; y < height; y += 2)
+		{
+			uchar *top = destination + y * stride;
+			uchar *bottom = (y + 1 < height) ? top + stride : 0;
+
+			convertLines(picture, width, y >> 1, top, bottom, format);
+		}
+	}
+
+	/// Converts the two luma lines sharing a chroma line
+	///
+	/// \param line the chroma line
+	/// \param bottom the destination of the second luma line, 0 for the last line of an odd height
+	void ColorConverter::convertLines(const VideoPicture &picture, int width, int line, uchar *top, uchar *bottom, PixelFormat format)
+	{
+		const qreal *cbIn = picture.chromaBlue().scanLine(line);
+		const qreal *crIn = picture.chromaRed().scanLine(line);
+		const qreal *lumaTop = picture.luma().scanLine(line << 1);
+		const qreal *lumaBottom = picture.luma().scanLine((line << 1) + 1);
+
+		int x = 0;
+
+#if defined(MPEG1_COLORCONVERTER_SSE2)
+		__m128i k1 = _mm_set1_epi16(K1);
+		__m128i k2 = _mm_set1_epi16(K2);
+		__m128i k3 = _mm_set1_epi16(K3);
+		__m128i k4 = _mm_set1_epi16(K4);
+
+		for(; x + 8 <= width; x += 8)
+		{
+			__m128i cb = loadChroma(cbIn + (x >> 1));
+			__m128i cr = loadChroma(crIn + (x >> 1));
+
+			__m128i redCr = _mm_add_epi16(cr, _mm_mulhi_epi16(cr, k1));
+			__m128i greenCbCr = _mm_add_epi16(_mm_mulhi_epi16(cb, k2), _mm_sub_epi16(cr, _mm_mulhi_epi16(cr, k3)));
+			__m128i blueCb = _mm_sub_epi16(_mm_slli_epi16(cb, 1), _mm_mulhi_epi16(cb, k4));
+
+			convertPixels8(top + x * 4, lumaTop + x, redCr, greenCbCr, blueCb, format);
+			if(bottom)
+				convertPixels8(bottom + x * 4, lumaBottom + x, redCr, greenCbCr, blueCb, format);
+		}
+#endif
+
+		for(; x < width; x += 2)
+		{
+			int chromaBlue = sample(cbIn[x >> 1]) - 128;
+			int chromaRed = sample(crIn[x >> 1]) - 128;
+
+			int redCr = C1 * chromaRed;
+			int greenCbCr = C2 * chromaBlue + C3 * chromaRed;
+			int blueCb = C4 * chromaBlue;
+
+			bool second = x + 1 < width;
+
+			convertPixel(top + x * 4, lumaTop[x], redCr, greenCbCr, blueCb, format);
+			if(second)
+				convertPixel(top + x * 4 + 4, lumaTop[x + 1], redCr, greenCbCr, blueCb, format);
+
+			if(!bottom)
+				continue;
+
+			convertPixel(bottom + x * 4, lumaBottom[x], redCr, greenCbCr, blueCb, format);
+			if(second)
+				convertPixel(bottom + x * 4 + 4, lumaBottom[x + 1], redCr, greenCbCr, blueCb, format);
+		}
+	}
+
+	/// The source samples an output column or row is made of
+	struct ScaleTap
+	{
+		int first;			//< The first source sample
+		int count;			//< The number of source samples from the first, 1 or 2 when bilinear
+		qreal fraction;		//< The weight of the second sample when bilinear
+	};
+
+	/// Maps each of outputLength output samples to the source samples it is filtered from
+	static QVector<ScaleTap> scaleTaps(int outputLength, int sourceLength, ColorConverter::ScaleFilter filter)
+	{
+		QVector<ScaleTap> taps(outputLength);
+
+		for(int i = 0; i < outputLength; i++)
+		{
+			ScaleTap &tap = taps[i];
+
+			if(filter == ColorConverter::FilterBox)
+			{
+				tap.first = (int)((qint64) i * sourceLength / outputLength);
+				tap.count = qMax((int)((qint64)(i + 1) * sourceLength / outputLength) - tap.first, 1);
+				tap.fraction = 0;
+				continue;
+			}
+
+			// Sample centres line up, so the output is not shifted against the source
+			qreal position = (i + 0.5) * sourceLength / outputLength - 0.5;
+			position = qBound((qreal) 0, position, (qreal)(sourceLength - 1));
+
+			tap.first = (int) position;
+			tap.count = (tap.first + 1 < sourceLength) ? 2 : 1;
+			tap.fraction = position - tap.first;
+		}
+
+		return taps;
+	}
+
+	/// Filters the samples of a plane covered by one output pixel
+	static inline qreal filterSamples(const Plane &plane, const ScaleTap &column, const ScaleTap &row, ColorConverter::ScaleFilter filter)
+	{
+		if(filter == ColorConverter::FilterBilinear)
+		{
+			const qreal *top = plane.scanLine(row.first);
+			const qreal *bottom = plane.scanLine(row.first + row.count - 1);
+			int right = column.first + column.count - 1;
+
+			qreal upper = top[column.first] + (top[right] - top[column.first]) * column.fraction;
+			qreal lower = bottom[column.first] + (bottom[right] - bottom[column.first]) * column.fraction;
+
+			return upper + (lower - upper) * row.fraction;
+		}
+
+		qreal sum = 0;
+		for(int y = row.first; y < row.first + row.count; y++)
+		{
+			const qreal *in = plane.scanLine(y);
+			for(int x = column.first; x < column.first + column.count; x++)
+				sum += in[x];
+		}
+
+		return sum / (row.count * column.count);
+	}
+
+	/// The state of one output of convertScaled()
+	struct ScaledConversion
+	{
+		const ColorConverter::ScaledOutput *output;
+
+		QVector<ScaleTap> lumaColumns;
+		QVector<ScaleTap> lumaRows;
+		QVector<ScaleTap> chromaColumns;
+		QVector<ScaleTap> chromaRows;
+
+		int nextRow;
+	};
+
+	static void convertScaledLine(const VideoPicture &picture, const ScaledConversion &conversion, int line, ColorConverter::ScaleFilter filter)
+	{
+		const ColorConverter::ScaledOutput &output = *conversion.output;
+		uchar *out = output.destination + line * output.stride;
+
+		const ScaleTap &lumaRow = conversion.lumaRows.at(line);
+		const ScaleTap &chromaRow = conversion.chromaRows.at(line);
+
+		for(int x = 0; x < output.size.width(); x++, out += 4)
+		{
+			const ScaleTap &chromaColumn = conversion.chromaColumns.at(x);
+
+			qreal luma = filterSamples(picture.luma(), conversion.lumaColumns.at(x), lumaRow, filter);
+			int chromaBlue = sample(filterSamples(picture.chromaBlue(), chromaColumn, chromaRow, filter)) - 128;
+			int chromaRed = sample(filterSamples(picture.chromaRed(), chromaColumn, chromaRow, filter)) - 128;
+
+			convertPixel(out, luma, C1 * chromaRed, C2 * chromaBlue + C3 * chromaRed, C4 * chromaBlue, output.format);
+		}
+	}
+
+	void ColorConverter::convertScaled(const VideoPicture &picture, const QSize &size, const ScaledOutput *outputs, int outputCount, ScaleFilter filter)
+	{
+		int width = qMin(size.width(), picture.luma().size().width());
+		int height = qMin(size.height(), picture.luma().size().height());
+
+		if(width <= 0 || height <= 0)
+			return;
+
+		int chromaWidth = (width + 1) >> 1;
+		int chromaHeight = (height + 1) >> 1;
+
+		QVector<ScaledConversion> conversions;
+		for(int i = 0; i < outputCount; i++)
+		{
+			const ScaledOutput &output = outputs[i];
+			if(output.size.isEmpty())
+				continue;
+
+			ScaledConversion conversion;
+			conversion.output = &output;
+			conversion.lumaColumns = scaleTaps(output.size.width(), width, filter);
+			conversion.lumaRows = scaleTaps(output.size.height(), height, filter);
+			conversion.chromaColumns = scaleTaps(output.size.width(), chromaWidth, filter);
+			conversion.chromaRows = scaleTaps(output.size.height(), chromaHeight, filter);
+			conversion.nextRow = 0;
+
+			conversions.append(conversion);
+		}
+
+		// Every output takes the lines which end within the macroblock row just reached
+		for(int bandEnd = 16; ; bandEnd += 16)
+		{
+			bandEnd = qMin(bandEnd, height);
+
+			for(int i = 0; i < conversions.count(); i++)
+			{
+				ScaledConversion &conversion = conversions[i];
+				int lines = conversion.lumaRows.count();
+
+				while(conversion.nextRow < lines)
+				{
+					const ScaleTap &row = conversion.lumaRows.at(conversion.nextRow);
+					if(row.first + row.count > bandEnd)
+						break;
+
+					convertScaledLine(picture, conversion, conversion.nextRow++, filter);
+				}
+			}
+
+			if(bandEnd == height)
+				break;
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#if !defined(MPEG1_COLORCONVERTER_H)
+#define MPEG1_COLORCONVERTER_H
+
+#include <QtCore/Qt>
+#include <QtCore/QSize>
+
+namespace Mpeg1
+{
+	/// Converts decoded pictures from YCbCr 4:2:0 to 32 bit RGB.
+	///
+	/// Each chroma row is shared by two luma rows, so the picture is converted two rows at a time
+	/// and the chroma contribution is computed once for four pixels. On processors with SSE2 eight
+	/// pixels of both rows are converted at once in 16 bit fixed point and packed straight into the
+	/// destination, otherwise a portable fixed point loop is used.
+	///
+	/// The conversion uses the ITU-R BT.601 coefficients of ISO/IEC 11172-2 Annex A.
+	///
+	/// convertScaled() produces smaller pictures such as thumbnails and previews, filtering the
+	/// planes as it converts rather than converting the whole picture and scaling the result.
+	class ColorConverter
+	{
+	public:
+		enum PixelFormat
+		{
+			FormatRgb32,		//< 0xffRRGGBB 32 bit words in native byte order, as QImage::Format_RGB32
+			FormatBgra,			//< Bytes in the order B, G, R, 0xff
+			FormatRgba			//< Bytes in the order R, G, B, 0xff
+		};
+
+		enum ScaleFilter
+		{
+			FilterBox,			//< Averages every sample covered by an output pixel. Best for large reductions.
+			FilterBilinear		//< Interpolates between the four nearest samples. Cheaper, and suits any size.
+		};
+
+		/// A picture produced by convertScaled()
+		struct ScaledOutput
+		{
+			ScaledOutput() :
+				destination(0),
+				stride(0),
+				format(FormatRgb32)
+			{
+			}
+
+			ScaledOutput(const QSize &size, uchar *destination, int stride, PixelFormat format = FormatRgb32) :
+				size(size),
+				destination(destination),
+				stride(stride),
+				format(format)
+			{
+			}
+
+			QSize size;				//< The size of the output in pixels
+			uchar *destination;		//< The first pixel of the top line of the output
+			int stride;				//< The number of bytes from one output line to the next
+			PixelFormat format;
+		};
+
+		/// Converts a picture
+		///
+		/// \param picture the decoded picture
+		/// \param size the size of the picture in pixels, as given by the sequence header
+		/// \param destination the first pixel of the top line of the destination
+		/// \param stride the number of bytes from one destination line to the next
+		/// \param format the layout of the destination pixels
+		/// \param firstLine the first line to convert, which must be even, so that separate bands of a
+		///                  picture can be converted on separate threads
+		/// \param lineCount the number of lines to convert, or -1 for every line to the bottom
+		static void convert(const class VideoPicture &picture, const QSize &size, uchar *destination, int stride, PixelFormat format = FormatRgb32, int firstLine = 0, int lineCount = -1);
+
+		/// Converts a picture to any number of other sizes at once
+		///
+		/// The picture is walked down once, a macroblock row at a time, and every output takes the
+		/// lines it needs from each row while it is in the cache, so the planes are read from memory
+		/// once however many outputs there are.
+		///
+		/// \param picture the decoded picture
+		/// \param size the size of the picture in pixels, as given by the sequence header
+		/// \param outputs the outputs to produce
+		/// \param outputCount the number of outputs
+		/// \param filter how the samples covered by an output pixel are combined
+		static void convertScaled(const class VideoPicture &picture, const QSize &size, const ScaledOutput *outputs, int outputCount, ScaleFilter filter = FilterBox);
+
+	private:
+		static void convertLines(const class VideoPicture &picture, int width, int line, uchar *top, uchar *bottom, PixelFormat format);
+	};
+}
+
+#endif
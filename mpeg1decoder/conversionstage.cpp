@@ -0,0 +1,158 @@
+#include "conversionstage.h"
+#include "videobuffer.h"
+#include "videopicture.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+
+namespace Mpeg1
+{
+	/// A picture being converted and the buffer it is written into
+	class PictureConversion
+	{
+	public:
+		PictureConversion(const VideoPicture *picture, int type, const VideoBuffer &buffer, int bands) :
+			picture(picture),
+			type(type),
+			buffer(buffer),
+			remainingBands(bands),
+			converted(false)
+		{
+			picture->ref();
+		}
+
+		const VideoPicture *picture;
+		int type;
+		VideoBuffer buffer;
+		QAtomicInt remainingBands;
+		bool converted;
+	};
+
+	/// Converts one band of rows of a picture
+	class ConversionBandJob : public QRunnable
+	{
+	public:
+		ConversionBandJob(ConversionStage *stage, PictureConversion *conversion, const QSize &size, int firstLine, int lineCount) :
+			m_stage(stage),
+			m_conversion(conversion),
+			m_size(size),
+			m_firstLine(firstLine),
+			m_lineCount(lineCount)
+		{
+		}
+
+		void run()
+		{
+			m_conversion->buffer.write(*m_conversion->picture, m_size, m_firstLine, m_lineCount);
+			m_stage->bandConverted(m_conversion);
+		}
+
+	private:
+		ConversionStage *m_stage;
+		PictureConversion *m_conversion;
+		QSize m_size;
+		int m_firstLine;
+		int m_lineCount;
+	};
+
+	ConversionStage::ConversionStage(VideoRenderer *renderer, Executor *executor, int maximumPending) :
+		m_renderer(renderer),
+		m_executor(executor),
+		m_stream(new Executor::Stream(executor)),
+		m_maximumPending(qMax(maximumPending, 1))
+	{
+	}
+
+	ConversionStage::~ConversionStage()
+	{
+		waitForDone();
+		delete m_stream;
+	}
+
+	void ConversionStage::waitForDone()
+	{
+		QMutexLocker locker(&m_mutex);
+		while (!m_conversions.isEmpty())
+			m_converted.wait(&m_mutex);
+	}
+
+	/// The renderer must have every picture of the previous sequence before the new parameters
+	void ConversionStage::setSize(int width, int height)
+	{
+		waitForDone();
+
+		m_size = QSize(width, height);
+		m_renderer->setSize(width, height);
+	}
+
+	void ConversionStage::setPixelAspectRatio(int aspectRatio)
+	{
+		m_renderer->setPixelAspectRatio(aspectRatio);
+	}
+
+	void ConversionStage::setPictureRate(int pictureRate)
+	{
+		m_renderer->setPictureRate(pictureRate);
+	}
+
+	void ConversionStage::setBitRate(int bitRate)
+	{
+		m_renderer->setBitRate(bitRate);
+	}
+
+	/// Starts converting a picture and returns, unless m_maximumPending pictures are being converted
+	void ConversionStage::pushPicture(const VideoPicture *picture, int type)
+	{
+		VideoBuffer buffer;
+		if (m_size.isEmpty() || !m_renderer->acquireBuffer(picture, type, buffer))
+		{
+			waitForDone();
+			m_renderer->pushPicture(picture, type);
+			return;
+		}
+
+		// One band per worker, in whole macroblock rows so no two bands share a chroma line
+		int height = m_size.height();
+		int bands = qMax(m_executor->threadCount(), 1);
+		int bandHeight = qMax((((height + bands - 1) / bands) + 15) & ~15, 16);
+		bands = (height + bandHeight - 1) / bandHeight;
+
+		PictureConversion *conversion = new PictureConversion(picture, type, buffer, bands);
+
+		{
+			QMutexLocker locker(&m_mutex);
+			while (m_conversions.count() >= m_maximumPending)
+				m_converted.wait(&m_mutex);
+
+			m_conversions.append(conversion);
+		}
+
+		for (int line = 0; line < height; line += bandHeight)
+			m_stream->start(new ConversionBandJob(this, conversion, m_size, line, bandHeight));
+	}
+
+	/// Called by a worker when it has converted a band. Once every band of the oldest pictures is
+	/// converted, they are passed on in display order.
+	void ConversionStage::bandConverted(PictureConversion *conversion)
+	{
+		if (conversion->remainingBands.deref())
+			return;
+
+		QMutexLocker locker(&m_mutex);
+
+		conversion->converted = true;
+
+		while (!m_conversions.isEmpty() && m_conversions.first()->converted)
+		{
+			PictureConversion *done = m_conversions.takeFirst();
+
+			done->picture->release();
+			m_renderer->pushBuffer(done->buffer, done->type);
+
+			delete done;
+		}
+
+		m_converted.wakeAll();
+	}
+}
@@ -0,0 +1,74 @@
+#if !defined(MPEG1_CONVERSIONSTAGE_H)
+#define MPEG1_CONVERSIONSTAGE_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSize>
+#include <QtCore/QWaitCondition>
+
+#include "executor.h"
+#include "videorenderer.h"
+
+namespace Mpeg1
+{
+	/// An output stage converting pictures into the buffers of a renderer on worker threads.
+	///
+	/// The stage is given to the decoder as its renderer and stands in front of the real one. Each
+	/// picture is written into the buffer given by the real renderer's acquireBuffer() by tasks on an
+	/// executor, one per band of rows, so the conversion of a picture is spread over the cores and
+	/// runs while the decoder goes on with the following pictures. Decoding and conversion together
+	/// then take about as long as the slower of the two rather than their sum.
+	///
+	/// The renderer gets the filled buffers through pushBuffer() in display order, on whichever
+	/// worker completed the conversion, and the stage drops its reference to each picture as soon as
+	/// it has been converted so it goes back to the decoder's pool. Pictures for which the renderer
+	/// declines a buffer are passed to its pushPicture() on the decoding thread, in order.
+	class ConversionStage : public VideoRenderer
+	{
+	public:
+		/// Constructs the stage
+		///
+		/// \param renderer the renderer receiving the converted pictures, which must outlive the stage
+		/// \param executor runs the conversion, which must outlive the stage
+		/// \param maximumPending the number of pictures converted at once, beyond which the decoder waits
+		ConversionStage(VideoRenderer *renderer, Executor *executor, int maximumPending = 2);
+
+		/// Destructor. Waits for the pictures being converted.
+		~ConversionStage();
+
+		/// Blocks until every picture given so far has been passed to the renderer
+		void waitForDone();
+
+		void setSize(int width, int height);
+
+		void pushPicture(const VideoPicture *picture, int type);
+
+		void setPixelAspectRatio(int aspectRatio);
+
+		void setPictureRate(int pictureRate);
+
+		void setBitRate(int bitRate);
+
+	private:
+		Q_DISABLE_COPY(ConversionStage)
+
+		friend class ConversionBandJob;
+
+		void bandConverted(class PictureConversion *conversion);
+
+	private:
+		VideoRenderer *m_renderer;
+		Executor *m_executor;
+		Executor::Stream *m_stream;
+		int m_maximumPending;
+
+		QSize m_size;
+
+		// Pictures being converted in display order
+		QList<class PictureConversion *> m_conversions;
+		QMutex m_mutex;
+		QWaitCondition m_converted;
+	};
+}
+
+#endif
@@ -1,13 +1,29 @@
 #include "decoder.h"
-#include "idct.h"
+#include "displayorder.h"
+#include "executor.h"
+#include "grouplocator.h"
 #include "inputbitstream.h"
-#include "motionvector.h"
+#include "macroblockbatch.h"
+#include "picturedecoder.h"
+#include "picturepool.h"
+#include "picturequeue.h"
+#include "reconstructor.h"
+#include "rowscheduler.h"
+#include "startcodeindex.h"
+#include "startcodes.h"
+#include "videobuffer.h"
 #include "videopicture.h"
 #include "videorenderer.h"
 #include "vlc.h"
 
 #include "utility.h"
 
+#include <QtCore/QBuffer>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QWaitCondition>
+
 namespace Mpeg1
 {
 	// Default intra quantization matrix
@@ -36,110 +52,575 @@ namespace Mpeg1
 		16, 16, 16, 16, 16, 16, 16, 16
 	};
 
-	// Zig-zag scan matrix
-	const quint8 Decoder::s_scanMatrix[] = 
-	{
-		0,  1,  5,  6, 14, 15, 27, 28,
-		2,  4,  7, 13, 16, 26, 29, 42,
-		3,  8, 12, 17, 25, 30, 41, 43,
-		9, 11, 18, 24, 31, 40, 44, 53,
-		10, 19, 23, 32, 39, 45, 52, 54,
-		20, 22, 33, 38, 46, 51, 55, 60,
-		21, 34, 37, 47, 50, 56, 59, 61,
-		35, 36, 48, 49, 57, 58, 62, 63
-	};
-
-	int Decoder::s_nullMatrix[] =
+	/// Parses and reconstructs a B picture on a worker thread.
+	///
+	/// The job parses its own copy of the slice data with its own copy of the slice level state.
+	/// Its batch holds a reference to the picture and to each anchor until the picture has been
+	/// reconstructed, and the job then deletes itself.
+	class BPictureJob : public QRunnable
 	{
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0
+	public:
+		BPictureJob(const PictureDecoder &pictureDecoder, VideoPicture *picture, const VideoPicture *previous, const VideoPicture *future) :
+			m_pictureDecoder(pictureDecoder),
+			m_batch(picture, previous, future)
+		{
+		}
+
+		/// The slices of the picture, terminated by a start code which is not a slice start code
+		QByteArray &sliceData()
+		{
+			return m_sliceData;
+		}
+
+		void run()
+		{
+			QBuffer buffer(&m_sliceData);
+			buffer.open(QIODevice::ReadOnly);
+
+			InputBitstream input(&buffer);
+			m_pictureDecoder.decodeSlices(&input, &m_batch);
+
+			// Waits for the anchors to be reconstructed by the row scheduler
+			Reconstructor::reconstruct(m_batch);
+		}
+
+	private:
+		PictureDecoder m_pictureDecoder;
+		QByteArray m_sliceData;
+
+		MacroblockBatch m_batch;
 	};
 
 	Decoder::Decoder(PictureQueue *queue, InputBitstream *input, VideoRenderer *renderer) :
 		m_queue(queue),
+		m_queueClosed(false),
 		m_input(input),
 		m_renderer(renderer),
-		m_current(0),
-		m_previous(-1),
-		m_future(-1),
 		m_currentPicture(0),
 		m_previousPicture(0),
-		m_futurePicture(0)
+		m_futurePicture(0),
+		m_executor(0),
+		m_ownsExecutor(false),
+		m_stream(0),
+		m_rowScheduler(0),
+		m_firstOfGroup(false),
+		m_closedGroup(false),
+		m_prepared(false),
+		m_pictureRate(0),
+		m_decodePolicy(DecodeAllPictures),
+		m_targetPictureRate(0),
+		m_groupFirstPicture(0),
+		m_groupPictures(0),
+		m_outputCurrent(true),
+		m_cacheCurrent(false),
+		m_seekMode(IndexedSeek),
+		m_index(0),
+		m_locator(0),
+		m_seekFrame(-1),
+		m_seekSequenceHeader(-1),
+		m_seekGroup(-1),
+		m_seekGroupFirstFrame(0),
+		m_groupOffset(-1),
+		m_anchorCacheSize(0),
+		m_state(StateBegin),
+		m_batch(0),
+		m_resolution(FullResolution),
+		m_lumaOnly(false)
+	{
+		m_picturePool = new PicturePool;
+		m_pictureDecoder = new PictureDecoder;
+		m_displayOrder = new DisplayOrder;
+	}
+
+	Decoder::~Decoder()
+	{
+		// Decoding may have been left between two steps
+		reset();
+		clearAnchorCache();
+
+		delete m_displayOrder;
+
+		delete m_index;
+		delete m_locator;
+
+		// Pictures still being reconstructed go back to the pool, so it has to outlive the threads
+		stopThreads();
+
+		delete m_pictureDecoder;
+		delete m_picturePool;
+	}
+
+	void Decoder::setThreadCount(int threadCount)
+	{
+		stopThreads();
+
+		if(threadCount <= 0)
+			return;
+
+		m_executor = new Executor(threadCount);
+		m_ownsExecutor = true;
+
+		startThreads(0, 1);
+	}
+
+	int Decoder::threadCount() const
+	{
+		return m_executor ? m_executor->threadCount() : 0;
+	}
+
+	void Decoder::setExecutor(Executor *executor, int priority, int weight)
+	{
+		stopThreads();
+
+		if(!executor)
+			return;
+
+		m_executor = executor;
+		m_ownsExecutor = false;
+
+		startThreads(priority, weight);
+	}
+
+	Executor *Decoder::executor() const
+	{
+		return m_executor;
+	}
+
+	void Decoder::setDecodePolicy(DecodePolicy policy)
 	{
-		for(int i=0; i<3; i++)
+		m_decodePolicy = policy;
+	}
+
+	Decoder::DecodePolicy Decoder::decodePolicy() const
+	{
+		return m_decodePolicy;
+	}
+
+	void Decoder::setTargetPictureRate(qreal picturesPerSecond)
+	{
+		m_targetPictureRate = picturesPerSecond;
+	}
+
+	qreal Decoder::targetPictureRate() const
+	{
+		return m_targetPictureRate;
+	}
+
+	void Decoder::setResolution(Resolution resolution)
+	{
+		// Cached anchors are in the pool format of the previous resolution
+		if (resolution != m_resolution)
+			clearAnchorCache();
+
+		m_resolution = resolution;
+	}
+
+	Decoder::Resolution Decoder::resolution() const
+	{
+		return m_resolution;
+	}
+
+	void Decoder::setLumaOnly(bool lumaOnly)
+	{
+		if (lumaOnly != m_lumaOnly)
+			clearAnchorCache();
+
+		m_lumaOnly = lumaOnly;
+	}
+
+	bool Decoder::lumaOnly() const
+	{
+		return m_lumaOnly;
+	}
+
+	bool Decoder::seekToFrame(int frame)
+	{
+		if (m_seekMode == ApproximateSeek)
 		{
-			m_videoPictureStore[i] = 0;
+			if (!m_locator)
+				m_locator = new GroupLocator(m_input->device());
+
+			GroupLocator::Location location;
+			if (!m_locator->locate(frame, location))
+				return false;
+
+			m_seekFrame = frame;
+			m_seekSequenceHeader = location.sequenceHeader;
+			m_seekGroup = location.group;
+			m_seekGroupFirstFrame = location.firstFrame;
+			m_state = StateBegin;
+
+			// Decoding starts over, so a cancel() no step has seen yet no longer applies
+			m_cancelled.fetchAndStoreOrdered(0);
+			return true;
 		}
 
-		m_forward = new MotionVector;
-		m_backward = new MotionVector;
+		if (frame < 0 || !buildIndex())
+			return false;
+
+		int target = m_index->findGroup(frame);
+		if (target < 0)
+			return false;
+
+		// The leading B pictures of an open group predict from the last anchor of the group before
+		const QVector<StartCodeIndex::Group> &groups = m_index->groups();
+		const StartCodeIndex::Group &group = groups.at(target);
+
+		int first = target;
+		if (!group.closed && target > 0 && frame < group.firstFrame + group.leadingFrames)
+			first = target - 1;
+
+		int sequenceHeader = m_index->sequenceHeaderFor(groups.at(first).entry);
+		if (sequenceHeader < 0)
+			return false;
+
+		m_seekFrame = frame;
+		m_seekSequenceHeader = m_index->at(sequenceHeader).offset;
+		m_seekGroup = m_index->at(groups.at(first).entry).offset;
+		m_seekGroupFirstFrame = groups.at(first).firstFrame;
+		m_state = StateBegin;
+		m_cancelled.fetchAndStoreOrdered(0);
+		return true;
 	}
 
-	Decoder::~Decoder()
+	bool Decoder::seekToTime(qreal seconds)
+	{
+		qreal rate = picturesPerSecond(firstPictureRate());
+		if (seconds < 0 || rate <= 0)
+			return false;
+
+		return seekToFrame((int)(seconds * rate));
+	}
+
+	void Decoder::setSeekMode(SeekMode mode)
+	{
+		m_seekMode = mode;
+	}
+
+	Decoder::SeekMode Decoder::seekMode() const
+	{
+		return m_seekMode;
+	}
+
+	/// Returns the picture_rate code of the first sequence header as the seek mode finds it, or 0
+	int Decoder::firstPictureRate()
+	{
+		if (m_seekMode == ApproximateSeek)
+		{
+			if (!m_locator)
+				m_locator = new GroupLocator(m_input->device());
+
+			return m_locator->pictureRate();
+		}
+
+		if (!buildIndex() || m_index->groups().isEmpty())
+			return 0;
+
+		int sequenceHeader = m_index->sequenceHeaderFor(m_index->groups().first().entry);
+		return sequenceHeader < 0 ? 0 : m_index->at(sequenceHeader).pictureRate;
+	}
+
+	void Decoder::setAnchorCacheSize(int groups)
+	{
+		m_anchorCacheSize = qMax(groups, 0);
+
+		while (m_anchorCache.count() > m_anchorCacheSize)
+			m_anchorCache.takeFirst().second->release();
+	}
+
+	int Decoder::anchorCacheSize() const
 	{
-		for(int i=0; i<3; i++)
+		return m_anchorCacheSize;
+	}
+
+	/// Indexes the start codes of the input the first time it is needed
+	bool Decoder::buildIndex()
+	{
+		if (m_index)
+			return true;
+
+		m_index = new StartCodeIndex;
+		if (!m_index->build(m_input->device(), m_executor))
 		{
-			delete m_videoPictureStore[i];
+			delete m_index;
+			m_index = 0;
+			return false;
+		}
+
+		return true;
+	}
+
+	/// Returns the cached I picture of the group starting at an offset, with a new reference, or 0
+	VideoPicture *Decoder::cachedAnchor(qint64 groupOffset)
+	{
+		for (int i = 0; i < m_anchorCache.count(); i++)
+		{
+			if (m_anchorCache.at(i).first != groupOffset)
+				continue;
+
+			// Most recently used last
+			QPair<qint64, VideoPicture *> entry = m_anchorCache.takeAt(i);
+			m_anchorCache.append(entry);
+
+			entry.second->ref();
+			return entry.second;
 		}
 
-		delete m_forward;
-		delete m_backward;
+		return 0;
+	}
+
+	/// Keeps the I picture starting the group at an offset, evicting the least recently used
+	void Decoder::cacheAnchor(qint64 groupOffset, VideoPicture *picture)
+	{
+		if (m_anchorCacheSize <= 0)
+			return;
+
+		picture->ref();
+		m_anchorCache.append(qMakePair(groupOffset, picture));
+
+		while (m_anchorCache.count() > m_anchorCacheSize)
+			m_anchorCache.takeFirst().second->release();
+	}
+
+	void Decoder::clearAnchorCache()
+	{
+		while (!m_anchorCache.isEmpty())
+			m_anchorCache.takeFirst().second->release();
+	}
+
+	void Decoder::startThreads(int priority, int weight)
+	{
+		m_stream = new Executor::Stream(m_executor, priority, weight);
+		m_rowScheduler = new RowScheduler(m_stream);
+	}
+
+	void Decoder::stopThreads()
+	{
+		delete m_rowScheduler;
+		m_rowScheduler = 0;
+
+		delete m_stream;
+		m_stream = 0;
+
+		if (m_ownsExecutor)
+			delete m_executor;
+		m_executor = 0;
+		m_ownsExecutor = false;
 	}
 
 	/// Remove any zero bit and zero byte stuffing and locates the next
 	/// start code. See ISO/IEC 11172-2 Section 2.3
 	void Decoder::nextStartCode()
 	{
-		// TODO : Replace with an extra function in InputBitstream to align
-		while (!m_input->isByteAligned())
-			m_input->getBits(1);
+		m_input->nextStartCode();
+	}
+
+	bool Decoder::prepare()
+	{
+		if (m_seekGroup >= 0)
+			m_input->seek(m_seekSequenceHeader);
+
+		nextStartCode();
 
-		// TODO : Replace with an extra function in InputBitstream to get 3 aligned bytes
-		while (m_input->nextBits(24) != StartCode)
-			m_input->getBits(8);
+		if (m_input->nextBits(32) != StartCodes::SequenceHeaderCode)
+			return false;
+
+		parseSequenceHeader();
+		configureSequence();
+
+		// The anchors, the picture being decoded, the anchor held for display order and the
+		// pictures waiting to be rendered while the workers are ahead
+		int pictureCount = 4 + m_anchorCacheSize;
+		if (m_executor)
+			pictureCount += threadCount() + 1;
+
+		m_picturePool->reserve(pictureCount);
+
+		Vlc::prefetchTables();
+
+		m_prepared = true;
+		m_state = StateBegin;
+		m_cancelled.fetchAndStoreOrdered(0);
+		return true;
 	}
 
 	void Decoder::start()
 	{
-		nextStartCode();
-  
+		while (decodeNextPicture() == PictureDecoded)
+			;
+	}
+
+	Decoder::DecodeStatus Decoder::decodeNextPicture()
+	{
+		DecodeStatus status;
+		do
+		{
+			status = decodeNextSlice();
+		} while (status == SliceDecoded);
+
+		return status;
+	}
+
+	Decoder::DecodeStatus Decoder::decodeNextSlice()
+	{
+		if (m_cancelled.fetchAndStoreOrdered(0))
+		{
+			reset();
+
+			if (m_queue)
+			{
+				m_queue->close();
+				m_queueClosed = true;
+			}
+
+			m_seekFrame = -1;
+			m_state = StateEnded;
+			return Cancelled;
+		}
+
+		if (m_state == StateBegin)
+			beginStream();
+		else if (m_batch)
+			return decodeSlice();
+
+		if (m_state == StateEnded)
+			return EndOfStream;
+
 		// A video sequence starts with a sequence header and is 
 		// followed by one or more groups of pictures and is ended 
 		// 
 		// by a SEQUENCE_END_CODE. Immediately before each of the 
 		// groups of pictures there may be a sequence header.
+		for (;;)
+		{
+			int code = m_input->nextBits(32);
+
+			if (code == StartCodes::SequenceHeaderCode)
+				beginSequence();
+			else if (code == StartCodes::GroupStartCode)
+				parseGroupOfPictures();
+			else if (code == StartCodes::PictureStartCode)
+				break;
+			else
+			{
+				endStream();
+				return EndOfStream;
+			}
+		}
+
+		parsePicture();
+
+		// The slices of a picture decoded on this thread are left to the following steps
+		if (m_batch)
+			return decodeSlice();
+
+		endPicture();
+		return PictureDecoded;
+	}
+
+	void Decoder::cancel()
+	{
+		m_cancelled.fetchAndStoreOrdered(1);
+	}
+
+	/// Positions the input for the first step, at the frame of a pending seek if there is one
+	void Decoder::beginStream()
+	{
+		m_state = StateDecoding;
+
+		// The consumer takes the pictures from here on as a new run
+		if (m_queue && (m_queueClosed || m_queue->isCancelled()))
+		{
+			m_queue->reopen();
+			m_queueClosed = false;
+		}
+
+		// Nothing decoded before a seek is displayed or predicted from after it
+		if (m_seekGroup >= 0)
+		{
+			reset();
+
+			// prepare() has parsed the sequence header of the seek already
+			if (!m_prepared)
+				m_input->seek(m_seekSequenceHeader);
+		}
 
-		do 
+		if (m_prepared)
+			beginSequence();
+		else
+			nextStartCode();
+	}
+
+	/// Parses a sequence header and sets up for it, unless prepare() has done so already
+	void Decoder::beginSequence()
+	{
+		// The renderer must have every picture of the previous sequence before its new parameters
+		m_displayOrder->flush(m_pendingPictures);
+		flushPendingPictures();
+
+		if (m_prepared)
+		{
+			m_prepared = false;
+		}
+		else
 		{
 			parseSequenceHeader();
+			configureSequence();
+		}
 
-			m_renderer->setSize(m_width, m_height);
+		// A seek decodes from its group under the sequence header in effect for it
+		if (m_seekGroup >= 0)
+		{
+			m_input->seek(m_seekGroup);
+			m_seekGroup = -1;
 
-			QSize blocks(m_macroblockWidth, m_macroblockHeight);
-			QSize lumaBlockSize(16, 16);
-			QSize chromaBlockSize(8, 8);
-			for(int i=0; i<3; i++)
-			{
-				m_videoPictureStore[i] = new VideoPicture;
-				if(!m_videoPictureStore[i]->allocate(blocks, lumaBlockSize, chromaBlockSize))
-					return;
-			}
-			m_currentPicture = m_videoPictureStore[m_current];
+			m_groupFirstPicture = m_seekGroupFirstFrame;
+			m_groupPictures = 0;
+		}
+	}
 
-			do 
-			{
-				parseGroupOfPictures();
-			} while (m_input->nextBits(32) == GroupStartCode);
+	/// Outputs the pictures left once the stream has ended
+	void Decoder::endStream()
+	{
+		m_displayOrder->flush(m_pendingPictures);
+		flushPendingPictures();
+
+		if (m_queue)
+		{
+			m_queue->close();
+			m_queueClosed = true;
+		}
+
+		if (m_input->nextBits(32) == StartCodes::SequenceEndCode)
+			m_input->skipBits(32);
+
+		m_seekFrame = -1;
+		m_state = StateEnded;
+	}
+
+	/// Drops everything decoded so far without outputting it, for a seek or a cancellation
+	void Decoder::reset()
+	{
+		// The rows no slice reached are completed empty
+		if (m_batch)
+		{
+			m_pictureDecoder->finishSlices();
+			if (!m_rowScheduler)
+				delete m_batch;
+
+			m_batch = 0;
+		}
 
-		} while (m_input->nextBits(32) == GroupStartCode);
+		if (m_currentPicture)
+			m_currentPicture->release();
+		m_currentPicture = 0;
+		m_cacheCurrent = false;
 
-		m_input->skipBits(32); // sequenceEndCode
+		while (!m_pendingPictures.isEmpty())
+			m_pendingPictures.takeFirst()->release();
+
+		m_displayOrder->clear();
+		releaseAnchors();
 	}
 
 	/// All fields in each sequence header with the exception of
@@ -158,8 +639,8 @@ namespace Mpeg1
 		int pelAspectRatio = m_input->getBits(4);
 		m_renderer->setPixelAspectRatio(pelAspectRatio);
 
-		int pictureRate = m_input->getBits(4);
-		m_renderer->setPictureRate(pictureRate);
+		m_pictureRate = m_input->getBits(4);
+		m_renderer->setPictureRate(m_pictureRate);
 
 		int bitRate = m_input->getBits(18);
 		m_renderer->setBitRate(bitRate);
@@ -186,11 +667,11 @@ namespace Mpeg1
 
 		nextStartCode();
 
-		if (m_input->nextBits(32) == ExtensionStartCode) 
+		if (m_input->nextBits(32) == StartCodes::ExtensionStartCode) 
 		{
 			m_input->getBits(32);
 
-			while (m_input->nextBits(24) != StartCode) 
+			while (m_input->nextBits(24) != StartCodes::StartCode) 
 			{
 				m_input->skipBits(8); // sequenceExtensionData
 			}
@@ -198,11 +679,11 @@ namespace Mpeg1
 			nextStartCode();
 		}
 
-		if (m_input->nextBits(32) == UserDataStartCode) 
+		if (m_input->nextBits(32) == StartCodes::UserDataStartCode) 
 		{
 			m_input->getBits(32);
 
-			while (m_input->nextBits(24) != StartCode) 
+			while (m_input->nextBits(24) != StartCodes::StartCode) 
 			{
 				m_input->skipBits(8); // userData
 			}
@@ -211,6 +692,22 @@ namespace Mpeg1
 		}
 	}
 
+	/// Sets up the renderer, the picture pool and the picture decoder for the sequence header
+	void Decoder::configureSequence()
+	{
+		QSize size = outputSize();
+		m_renderer->setSize(size.width(), size.height());
+
+		// Blocks are 8x8 samples at full size and shrink with the resolution
+		int blockSize = 8 >> m_resolution;
+		m_picturePool->setFormat(QSize(m_macroblockWidth, m_macroblockHeight), QSize(blockSize * 2, blockSize * 2), QSize(blockSize, blockSize), m_lumaOnly);
+
+		m_pictureDecoder->setBlockSize(blockSize);
+		m_pictureDecoder->setLumaOnly(m_lumaOnly);
+		m_pictureDecoder->setMacroblockWidth(m_macroblockWidth);
+		m_pictureDecoder->setQuantizerMatrices(m_intraQuantizerMatrix, m_nonIntraQuantizerMatrix);
+	}
+
 	/// This is a list of sixty-four 8-bit unsigned integers.
 	/// The value for [0][0] shall always be 8. For the 8-bit 
 	/// unsigned integers, the value zero is forbidden.
@@ -256,6 +753,8 @@ namespace Mpeg1
 	/// is either an I-Picture or a P-Picture.
 	void Decoder::parseGroupOfPictures()
 	{
+		m_groupOffset = m_input->position();
+
 		m_input->skipBits(32);	// groupStartCode
 		m_input->skipBits(25);	// timeCode
 		bool closedGop = m_input->getBool();
@@ -263,11 +762,11 @@ namespace Mpeg1
 
 		nextStartCode();
 
-		if (m_input->nextBits(32) == ExtensionStartCode) 
+		if (m_input->nextBits(32) == StartCodes::ExtensionStartCode) 
 		{
 			m_input->getBits(32);
 
-			while (m_input->nextBits(24) != StartCode) 
+			while (m_input->nextBits(24) != StartCodes::StartCode) 
 			{
 				m_input->getBits(8);	// groupExtensionData
 			}
@@ -275,11 +774,11 @@ namespace Mpeg1
 			nextStartCode();
 		}
 
-		if (m_input->nextBits(32) == UserDataStartCode) 
+		if (m_input->nextBits(32) == StartCodes::UserDataStartCode) 
 		{
 			m_input->getBits(32);
 
-			while (m_input->nextBits(24) != StartCode) 
+			while (m_input->nextBits(24) != StartCodes::StartCode) 
 			{
 				m_input->getBits(8); // userData
 			}
@@ -287,45 +786,18 @@ namespace Mpeg1
 			nextStartCode();
 		}
 
-		// Reset picture store indexes
+		// Pictures of a closed GOP never reference the previous GOP
 		if (closedGop) 
 		{
-			m_previous = m_future = -1;
+			releaseAnchors();
 		}
 
-		do 
-		{
-			parsePicture();
+		m_closedGroup = closedGop;
 
-    		// Send picture to player
-			m_renderer->pushPicture(m_currentPicture, m_pictureCodingType);
-			
-			// Store current picture in Previous or Future Picture Store
-    		// Refer to section 2-D.2.4
-			if (m_pictureCodingType == VideoPicture::PictureCodingI || m_pictureCodingType == VideoPicture::PictureCodingP) 
-			{
-           		if (m_previous == -1)
-           		{
-           			m_previous = m_current;
-           		}
-           		else if (m_future == -1)
-           		{
-           			m_future = m_current;
-           		}
-           		else
-           		{
-           			m_future = m_current;
-           		}
-
-           		m_current = (m_current + 1) % 3;
-			}
-			m_currentPicture = m_videoPictureStore[m_current];
-			if(m_previous >= 0) 
-				m_previousPicture = m_videoPictureStore[m_previous];
-			if(m_future >= 0) 
-				m_futurePicture = m_videoPictureStore[m_future];
+		m_firstOfGroup = true;
 
-		} while (m_input->nextBits(32) == PictureStartCode);
+		m_groupFirstPicture += m_groupPictures;
+		m_groupPictures = 0;
 	}
 
 	void Decoder::parsePicture()
@@ -335,36 +807,72 @@ namespace Mpeg1
 		m_pictureCodingType = m_input->getBits(3);
 		m_input->getBits(16); // vbvDelay
 
+		m_groupPictures++;
+		m_cacheCurrent = false;
+
+		// No picture before the frame sought is output
+		int number = m_groupFirstPicture + temporalReference;
+		m_outputCurrent = number >= m_seekFrame && isPictureWanted(m_pictureCodingType, temporalReference);
+
+		// Anchors are still decoded for the pictures which may predict from them : every anchor
+		// while decimating, and those before the frame sought unless only I pictures are wanted
+		bool anchor = m_pictureCodingType == VideoPicture::PictureCodingI || m_pictureCodingType == VideoPicture::PictureCodingP;
+		bool predictedFrom = anchor && m_decodePolicy != DecodeIntraPictures && (m_decodePolicy == DecodeDecimated || number < m_seekFrame);
+
+		if (!m_outputCurrent && !predictedFrom)
+		{
+			skipOutput(m_pictureCodingType, temporalReference);
+			skipPicture();
+			return;
+		}
+
+		// The I picture starting a group is taken from the cache when the group was decoded before
+		bool groupAnchor = m_groupPictures == 1 && m_pictureCodingType == VideoPicture::PictureCodingI && m_anchorCacheSize > 0;
+		if (groupAnchor)
+		{
+			m_currentPicture = cachedAnchor(m_groupOffset);
+			if (m_currentPicture)
+			{
+				skipPicture();
+				return;
+			}
+		}
+
+		// Without a picture to decode into the current one is dropped, and so is every picture
+		// predicting from it up to the next I picture
+		m_currentPicture = m_picturePool->acquire();
+		if (!m_currentPicture)
+		{
+			releaseAnchors();
+
+			skipOutput(m_pictureCodingType, temporalReference);
+			skipPicture();
+			return;
+		}
+
 		// This data is to be used later by the player
 		m_currentPicture->setTemporalReference(temporalReference);
 		m_currentPicture->setPictureType((VideoPicture::PictureCoding) m_pictureCodingType);
 
-		// "Copy" picture from Future Picture Store to Previous Picture Store
-		// Refer to section 2-D.2.4
-		if (m_pictureCodingType == VideoPicture::PictureCodingI || m_pictureCodingType == VideoPicture::PictureCodingP)
-		{
-			if (m_future != -1)
-        		m_previous = m_future;
-		}
+		// A picture interrupted by cancel() or a seek is never cached, see endPicture()
+		m_cacheCurrent = groupAnchor;
+
+		m_pictureDecoder->setPictureType(m_pictureCodingType);
 
 		if (m_pictureCodingType == VideoPicture::PictureCodingP || m_pictureCodingType == VideoPicture::PictureCodingB) 
 		{
 			bool fullPelForwardVector = m_input->getBits(1) == 1;
 			int forwardFCode = m_input->getBits(3);  // Can't be 0
-			m_forwardRSize = forwardFCode - 1;
-			m_forwardF = 1 << m_forwardRSize;
 
-			m_forward->initialize(m_forwardF, fullPelForwardVector);
+			m_pictureDecoder->setForwardVector(forwardFCode, fullPelForwardVector);
 		}
 
 		if (m_pictureCodingType == VideoPicture::PictureCodingB) 
 		{
 			bool fullPelBackwardVector = m_input->getBits(1) == 1;
 			int backwardFCode = m_input->getBits(3); // Can't be 0
-			m_backwardRSize = backwardFCode - 1;
-			m_backwardF = 1 << m_backwardRSize;
 
-			m_backward->initialize(m_backwardF, fullPelBackwardVector);
+			m_pictureDecoder->setBackwardVector(backwardFCode, fullPelBackwardVector);
 		}
 
 		bool extraBitPicture = 0;
@@ -377,11 +885,11 @@ namespace Mpeg1
 
 		nextStartCode();
 
-		if (m_input->nextBits(32) == ExtensionStartCode) 
+		if (m_input->nextBits(32) == StartCodes::ExtensionStartCode) 
 		{
 			m_input->skipBits(32);
 
-			while (m_input->nextBits(24) != StartCode) 
+			while (m_input->nextBits(24) != StartCodes::StartCode) 
 			{
 				m_input->skipBits(8); // pictureExtensionData
 			}
@@ -389,11 +897,11 @@ namespace Mpeg1
 			nextStartCode();
 		}
 
-		if (m_input->nextBits(32) == UserDataStartCode) 
+		if (m_input->nextBits(32) == StartCodes::UserDataStartCode) 
 		{
 			m_input->skipBits(32);
 
-			while (m_input->nextBits(24) != StartCode) 
+			while (m_input->nextBits(24) != StartCodes::StartCode) 
 			{
 				m_input->getBits(8); // userData
 			}
@@ -401,457 +909,225 @@ namespace Mpeg1
 			nextStartCode();
 		}
 
-		do {
-			parseSlice();
-		} while (m_input->nextBits(32) == SliceStartCode);
-	}
-
-	/// A slice is a series of an arbitrary number of macroblocks with 
-	/// the order of macroblocks starting from the upper-left of the 
-	/// picture and proceeding by raster-scan order from left to right 
-	/// and top to bottom. Every slice shall contain at least one 
-	/// macroblock. Slices shall not overlap and there shall be no gaps 
-	/// between slices.
-	void Decoder::parseSlice()
-	{
-		int sliceStartCode = m_input->getBits(32);   // Ranging from 0x00000101 - 0x000001af
-		int sliceVerticalPosition = sliceStartCode & 0xff; // Range: 0x01 - 0xaf
-
-		m_dctDcYPast = m_dctDcCbPast = m_dctDcCrPast = 1024; // See ISO-11172-2 page 35
-		m_pastIntraAddress = -2; // See ISO-11172-2 page 36
+		// The leading B pictures of an open GOP predict from the GOP before it. When decoding starts
+		// at such a GOP there is nothing to predict from, so they are dropped as for a broken link.
+		// See ISO/IEC 11172-2 2.4.3.4. Pictures predicting from an anchor which was dropped go too.
+		bool missingAnchor = false;
+		if (m_pictureCodingType == VideoPicture::PictureCodingB)
+			missingAnchor = !m_futurePicture || (!m_previousPicture && !m_closedGroup);
+		else if (m_pictureCodingType == VideoPicture::PictureCodingP)
+			missingAnchor = !m_futurePicture;
 
-		// Reset at start of each slice
-		m_forward->resetPrevious();
-		m_backward->resetPrevious();
-
-		// Macroblocks have an address which is the number of the macroblock 
-		// in raster scan order. The top left macroblock in a picture has 
-		// address 0, the next one to the right has address 1 and so on. 
-		// If there are M macroblocks in a picture, then the bottom right 
-		// macroblock has an address M-1.
-		m_macroblockAddress = (sliceVerticalPosition - 1) * m_macroblockWidth - 1;
-
-		m_quantizerScale = m_input->getBits(5);
-
-		bool extraBitSlice = 0;
-		while (m_input->nextBool()) 
+		if (missingAnchor)
 		{
-			extraBitSlice = m_input->getBool();
-			m_input->getBits(8);	// extraInformationSlice
-		}
-		extraBitSlice = m_input->getBits(1);
+			m_currentPicture->release();
+			m_currentPicture = 0;
 
-		do 
-		{
-			parseMacroblock();
-		} while (m_input->nextBits(23) != 0x0);
-
-		nextStartCode();
-	}
-
-	/// A macroblock has 4 luminance blocks and 2 chrominance blocks.
-	/// The order of blocks in a macroblock is top-left, top-right, 
-	/// bottom-left, bottom-right block for Y, followed by Cb and Cr.
-	/// A macroblock is the basic unit for motion compensation and 
-	/// quantizer scale changes.
-	void Decoder::parseMacroblock()
-	{
-		// Discarded by decoder
-		while (m_input->nextBits(11) == 0xf) 
-		{
-			m_input->skipBits(11);	// macroblockStuffing
+			skipOutput(m_pictureCodingType, temporalReference);
+			skipPicture();
+			return;
 		}
 
-		int macroblockAddressIncrement = 0;
-
-		while (m_input->nextBits(11) == 0x8) 
+		if (m_pictureCodingType == VideoPicture::PictureCodingB && m_stream) 
 		{
-			m_input->skipBits(11);	// macroblockEscape
-			macroblockAddressIncrement += 33;
+			dispatchPicture();
+			return;
 		}
 
-		macroblockAddressIncrement += Vlc::getMacroblockAddressIncrement(m_input);
-
-		// Process skipped macroblocks
-		if (macroblockAddressIncrement > 1) 
-		{
-			m_dctDcYPast = m_dctDcCrPast = m_dctDcCbPast = 1024;
-
-			if (m_pictureCodingType == VideoPicture::PictureCodingP) 
-			{
-				// In P-pictures, the skipped macroblock is defined to be 
-				// a macroblock with a reconstructed motion vector equal 
-				// to zero and no DCT coefficients.
-
-				m_forward->resetPrevious();
-
-				for (int i = 0; i < macroblockAddressIncrement; ++i) 
-				{
-					int macroblockAddress = m_macroblockAddress + 1 + i;
-					m_currentPicture->copyMacroblock(*m_previousPicture, macroblockAddress);
-				}
-			}
-			else if (m_pictureCodingType == VideoPicture::PictureCodingB) 
-			{
-				// In B-pictures, the skipped macroblock is defined to have 
-				// the same macroblock_type (forward, backward, or both motion 
-				// vectors) as the prior macroblock, differential motion 
-				// vectors equal to zero, and no DCT coefficients.
-				for (int i = 0; i < macroblockAddressIncrement; ++i) 
-				{
-					quint32 macroblockAddress = m_macroblockAddress + 1 + i;
-
-    				if (!m_macroblockType.macroblockMotionForward() && m_macroblockType.macroblockMotionBackward())
-						m_currentPicture->compensate(*m_futurePicture, macroblockAddress, *m_backward);
-    				else if (m_macroblockType.macroblockMotionForward() && !m_macroblockType.macroblockMotionBackward())
-						m_currentPicture->compensate(*m_previousPicture, macroblockAddress, *m_forward);
-    				else if (m_macroblockType.macroblockMotionForward() && m_macroblockType.macroblockMotionBackward()) 
-						m_currentPicture->interpolate(*m_previousPicture, *m_forward, *m_futurePicture, *m_backward, macroblockAddress);
-				}
-			}
-		}
+		// I and P pictures predict from the most recent anchor
+		if (m_pictureCodingType == VideoPicture::PictureCodingB)
+			m_batch = new MacroblockBatch(m_currentPicture, m_previousPicture, m_futurePicture);
+		else
+			m_batch = new MacroblockBatch(m_currentPicture, m_futurePicture, 0);
 
-		m_macroblockAddress += macroblockAddressIncrement;
+		// Rows are reconstructed on the workers while the rest of the picture is parsed
+		if (m_rowScheduler)
+			m_rowScheduler->schedule(m_batch);
 
-		m_macroblockRow = m_macroblockAddress / m_macroblockWidth;
-		m_macroblockColumn = m_macroblockAddress % m_macroblockWidth;
+		m_pictureDecoder->beginSlices(m_input, m_batch);
+	}
 
-		// For macroblocks in I pictures, and for intra coded macroblocks in 
-		// P and B pictures, the coded block pattern is not transmitted, but 
-		// is assumed to have a value of 63, i.e. all the blocks in the 
-		// macroblock are coded.
-		int codedBlockPattern = 0x3f;
+	/// Parses the next slice of the picture decoded on this thread, and finishes the picture after
+	/// its last slice
+	Decoder::DecodeStatus Decoder::decodeSlice()
+	{
+		if (m_pictureDecoder->decodeNextSlice() && StartCodes::isSliceStartCode(m_input->nextBits(32)))
+			return SliceDecoded;
 
-		Vlc::getMacroblockType(m_pictureCodingType, m_input, m_macroblockType);
+		m_pictureDecoder->finishSlices();
 
-		if (!m_macroblockType.macroblockIntra()) 
+		if (!m_rowScheduler)
 		{
-			m_dctDcYPast = m_dctDcCrPast = m_dctDcCbPast = 1024;
-			codedBlockPattern = 0;
+			Reconstructor::reconstruct(*m_batch);
+			delete m_batch;
 		}
 
-		if (m_macroblockType.macroblockQuant())
-			m_quantizerScale = m_input->getBits(5);
+		m_batch = 0;
 
-		if (m_macroblockType.macroblockMotionForward()) 
-		{
-			int motionHorizontalForwardCode = Vlc::getMotionVector(m_input);
-			if (m_forwardF != 1 && motionHorizontalForwardCode != 0) 
-			{
-				m_motionHorizontalForwardR = m_input->getBits(m_forwardRSize);
-			}
+		endPicture();
+		return PictureDecoded;
+	}
 
-			int motionVerticalForwardCode = Vlc::getMotionVector(m_input);
-			if (m_forwardF != 1 && motionVerticalForwardCode != 0) 
-			{
-				m_motionVerticalForwardR = m_input->getBits(m_forwardRSize);
-			}
+	/// Outputs the current picture and moves it into the anchors
+	void Decoder::endPicture()
+	{
+		if (m_currentPicture && m_cacheCurrent)
+			cacheAnchor(m_groupOffset, m_currentPicture);
+		m_cacheCurrent = false;
 
-			m_forward->calculate(motionHorizontalForwardCode, m_motionHorizontalForwardR, motionVerticalForwardCode, m_motionVerticalForwardR);
-		}
+		if (m_currentPicture && m_outputCurrent)
+			pushPicture(m_currentPicture);
+		else if (m_currentPicture)
+			skipOutput(m_pictureCodingType, m_currentPicture->temporalReference());
 
-		if (m_macroblockType.macroblockMotionBackward()) 
+		// Store current picture in Previous or Future Picture Store
+		// Refer to section 2-D.2.4
+		if (m_pictureCodingType == VideoPicture::PictureCodingI || m_pictureCodingType == VideoPicture::PictureCodingP) 
 		{
-			int motionHorizontalBackwardCode = Vlc::getMotionVector(m_input);
-			if (m_backwardF != 1 && motionHorizontalBackwardCode != 0) 
-			{
-				m_motionHorizontalBackwardR = m_input->getBits(m_backwardRSize);
-			}
-
-			int motionVerticalBackwardCode = Vlc::getMotionVector(m_input);
-			if (m_backwardF != 1 && motionVerticalBackwardCode != 0) 
-			{
-				m_motionVerticalBackwardR = m_input->getBits(m_backwardRSize);
-			}
-
-			m_backward->calculate(motionHorizontalBackwardCode, m_motionHorizontalBackwardR, motionVerticalBackwardCode, m_motionVerticalBackwardR);
-		}
-
-		if (m_pictureCodingType == VideoPicture::PictureCodingP) // See 2.4.4.2
-		{	
-			if (m_macroblockType.macroblockMotionForward()) 
-				m_currentPicture->compensate(*m_previousPicture, m_macroblockAddress, *m_forward);
-			else
-				m_currentPicture->copyMacroblock(*m_previousPicture, m_macroblockAddress);
-		}
-		else if (m_pictureCodingType == VideoPicture::PictureCodingB) // See 2.4.4.3
-		{	
-			if (m_macroblockType.macroblockMotionForward() && !m_macroblockType.macroblockMotionBackward()) 
-				m_currentPicture->compensate(*m_previousPicture, m_macroblockAddress, *m_forward);
-			else if(!m_macroblockType.macroblockMotionForward() && m_macroblockType.macroblockMotionBackward()) 
-				m_currentPicture->compensate(*m_futurePicture, m_macroblockAddress, *m_backward);
-			else if (m_macroblockType.macroblockMotionForward() && m_macroblockType.macroblockMotionBackward()) 
-				m_currentPicture->interpolate(*m_previousPicture, *m_forward, *m_futurePicture, *m_backward, m_macroblockAddress);
-		}
+			if (m_previousPicture)
+				m_previousPicture->release();
 
-		if (m_pictureCodingType == VideoPicture::PictureCodingP && !m_macroblockType.macroblockMotionForward())
-			m_forward->resetPrevious();
-
-		if (m_pictureCodingType == VideoPicture::PictureCodingB && m_macroblockType.macroblockIntra()) 
-		{
-			m_forward->resetPrevious();
-			m_backward->resetPrevious();
+			m_previousPicture = m_futurePicture;
+			m_futurePicture = m_currentPicture;
 		}
-
-		if (m_macroblockType.macroblockPattern())
-			codedBlockPattern = Vlc::getCodedBlockPattern(m_input);
-
-		// The Coded Block Pattern informs the decoder which of the six blocks 
-		// in the macroblock are coded, i.e. have transmitted DCT quantized 
-		// coefficients, and which are not coded, i.e. have no additional 
-		// correction after motion compensation
-		for (int i = 0; i < 6; i++)	
+		else if (m_currentPicture)
 		{
-			if ((codedBlockPattern & (1 << (5 - i))) != 0) 
-			{
-				parseBlock(i);
-
-				if (m_macroblockType.macroblockIntra()) 
-				{
-					if (i < 4) 
-						m_currentPicture->luma().setBlock8x8(m_dctRecon, m_macroblockAddress, i);
-					else if(i == 5)
-						m_currentPicture->chromaRed().setBlock8x8(m_dctRecon, m_macroblockAddress, 0);
-					else
-						m_currentPicture->chromaBlue().setBlock8x8(m_dctRecon, m_macroblockAddress, 0);					
-				}
-				else 
-				{
-					if (i < 4) 
-						m_currentPicture->luma().correctBlock8x8(m_dctRecon, m_macroblockAddress, i);
-					else if(i == 5)
-						m_currentPicture->chromaRed().correctBlock8x8(m_dctRecon, m_macroblockAddress, 0);
-					else
-						m_currentPicture->chromaBlue().correctBlock8x8(m_dctRecon, m_macroblockAddress, 0);		
-				}
-			}
+			m_currentPicture->release();
 		}
 
-		if (m_pictureCodingType == VideoPicture::PictureCodingD)
-			m_input->getBits(1);
+		m_currentPicture = 0;
 	}
 
-	/// A block is an orthogonal 8-pel by 8-line section of a 
-	/// luminance or chrominance component.
-	void Decoder::parseBlock(int index)
+	/// Returns true if the decode policy outputs a picture
+	bool Decoder::isPictureWanted(int pictureType, int temporalReference) const
 	{
-		Vlc::RunLevel runLevel;
+		switch (m_decodePolicy)
+		{
+		case DecodeAllPictures:
+			return true;
 
-		copyInts(s_nullMatrix, 0, m_dctRecon, 0, 64);
-		copyInts(s_nullMatrix, 0, m_dctZigzag, 0, 64);
+		case DecodeIntraPictures:
+			return pictureType == VideoPicture::PictureCodingI || pictureType == VideoPicture::PictureCodingD;
 
-		int run = 0;
+		case DecodeAnchorPictures:
+			return pictureType != VideoPicture::PictureCodingB;
 
-		if (m_macroblockType.macroblockIntra()) 
-		{
-			if (index < 4) 
-			{
-				int dctDCSizeLuminance = Vlc::decodeDCTDCSizeLuminance(m_input);
-				int dctDCDifferential = 0;
-
-				if (dctDCSizeLuminance != 0) 
-				{
-					dctDCDifferential = m_input->getBits(dctDCSizeLuminance);
-
-					if ((dctDCDifferential & (1 << (dctDCSizeLuminance - 1))) != 0)
-						m_dctZigzag[0] = dctDCDifferential;
-					else
-						m_dctZigzag[0] = ((-1 << dctDCSizeLuminance) | (dctDCDifferential + 1));
-				}
-			}
-			else 
-			{
-				int dctDCSizeChrominance = Vlc::decodeDCTDCSizeChrominance(m_input);
-				int dctDCDifferential = 0;
-
-				if (dctDCSizeChrominance != 0) 
-				{
-					dctDCDifferential = m_input->getBits(dctDCSizeChrominance);
-
-					if ((dctDCDifferential & (1 << (dctDCSizeChrominance - 1))) != 0)
-						m_dctZigzag[0] = dctDCDifferential;
-					else
-						m_dctZigzag[0] = ((-1 << dctDCSizeChrominance) | (dctDCDifferential + 1));
-				}
-			}
+		case DecodeDecimated:
+			break;
 		}
-		else 
-		{
-			// dctCoeffFirst
-			Vlc::decodeDCTCoeff(m_input, true, runLevel);
 
-			run = runLevel.run();
-			m_dctZigzag[run] = runLevel.level();
-		}
+		qreal sourceRate = picturesPerSecond(m_pictureRate);
+		if (m_targetPictureRate <= 0 || sourceRate <= 0)
+			return true;
 
-		if (m_pictureCodingType != VideoPicture::PictureCodingD) 
-		{
-			while (m_input->nextBits(2) != 0x2) 
-			{
-				// dctCoeffNext
-				Vlc::decodeDCTCoeff(m_input, false, runLevel);
+		// The first picture of each period of the target rate, in display order
+		int number = m_groupFirstPicture + temporalReference;
+		qreal step = m_targetPictureRate / sourceRate;
 
-				run += runLevel.run() + 1;
-				m_dctZigzag[run] = runLevel.level();
-			}
+		return number == 0 || (qint64)(number * step) != (qint64)((number - 1) * step);
+	}
 
-			m_input->skipBits(2); // endOfBlock, Should be == 0x2 (EOB)
+	/// Steps over the rest of the current picture, up to the start code which follows its last
+	/// slice, without decoding anything.
+	void Decoder::skipPicture()
+	{
+		m_input->nextStartCode();
 
-			if (m_macroblockType.macroblockIntra()) 
-			{
-				if (index == 0)
-					firstLuminanceBlock(m_dctRecon);
-				else if (index >= 1 && index <= 3)
-					nextLuminanceBlock(m_dctRecon);
-				else if (index == 4)
-					cbBlock(m_dctRecon);
-				else if (index == 5)
-					crBlock(m_dctRecon);
-
-				m_pastIntraAddress = m_macroblockAddress;
-			}
-			else
-			{
-				// See ISO/IEC 11172 2.4.4.2 / 2.4.4.3
-				for (int i = 0; i < 64; ++i) 
-				{
-					int idx = s_scanMatrix[i];
-					m_dctRecon[i] = ((2 * m_dctZigzag[idx] + sign(m_dctZigzag[idx])) * m_quantizerScale * m_nonIntraQuantizerMatrix[i]) >> 4;
-
-					if ((m_dctRecon[i] & 1) == 0) 
-					{
-						m_dctRecon[i] -= sign(m_dctRecon[i]);
-						if (m_dctRecon[i] > 2047) 
-							m_dctRecon[i] = 2047;
-
-						if (m_dctRecon[i] < -2048) 
-							m_dctRecon[i] = -2048;
-
-						if (m_dctZigzag[idx] == 0)
-							m_dctRecon[i] = 0;
-					}
-				}
-			}
+		for (;;)
+		{
+			int code = m_input->nextBits(32);
+			if (!StartCodes::isSliceStartCode(code) && code != StartCodes::ExtensionStartCode && code != StartCodes::UserDataStartCode)
+				break;
 
-			Idct::calculate(m_dctRecon);
+			m_input->skipToNextStartCode();
 		}
 	}
 
-	/// Helper function
-	int Decoder::sign(int n) 
+	/// Lets the pictures displayed after a picture which is not output go by without waiting for it
+	void Decoder::skipOutput(int pictureType, int temporalReference)
 	{
-		return n > 0 ? 1 : (n < 0 ? -1 : 0);
+		m_displayOrder->skip(pictureType, temporalReference, m_firstOfGroup, m_pendingPictures);
+		m_firstOfGroup = false;
+
+		flushPendingPictures(m_executor ? threadCount() + 1 : 0);
 	}
 
-	/// Reconstruct DCT coefficients, as defined in ISO/IEC 11172 2.4.4.1
-	void Decoder::firstLuminanceBlock(int *dctRecon)
+	/// Hands the slices of the current B picture to a worker thread.
+	///
+	/// The slices are copied out of the bitstream and terminated with a sequence end code so the
+	/// worker can parse them on its own.
+	void Decoder::dispatchPicture()
 	{
-		for (int i = 0; i < 64; ++i) 
-		{
-			int index = s_scanMatrix[i];
-			dctRecon[i] = (m_dctZigzag[index] * m_quantizerScale * m_intraQuantizerMatrix[i]) >> 3;
-
-			if ((dctRecon[i] & 1) == 0) 
-			{
-				dctRecon[i] -= sign(dctRecon[i]);
+		BPictureJob *job = new BPictureJob(*m_pictureDecoder, m_currentPicture, m_previousPicture, m_futurePicture);
 
-				if (dctRecon[i] > 2047) 
-					dctRecon[i] = 2047;
+		while (StartCodes::isSliceStartCode(m_input->nextBits(32)))
+			m_input->readToNextStartCode(job->sliceData());
 
-				if (dctRecon[i] < -2048) 
-					dctRecon[i] = -2048;
-			}
-		}
+		static const char sequenceEndCode[] = { 0x00, 0x00, 0x01, (char) 0xb7 };
+		job->sliceData().append(sequenceEndCode, sizeof(sequenceEndCode));
 
-		dctRecon[0] = m_dctZigzag[0] << 3;
+		m_stream->start(job);
+	}
 
-		if (m_macroblockAddress - m_pastIntraAddress > 1)
-			dctRecon[0] += 1024;
-		else
-			dctRecon[0] += m_dctDcYPast;
+	/// Queues a picture for the renderer. Pictures are sent in display order once they have been
+	/// reconstructed, and at most a few are kept waiting so the threads can work ahead.
+	void Decoder::pushPicture(VideoPicture *picture)
+	{
+		picture->ref();
+		m_displayOrder->push(picture, m_firstOfGroup, m_pendingPictures);
+		m_firstOfGroup = false;
 
-		m_dctDcYPast = dctRecon[0];
+		flushPendingPictures(m_executor ? threadCount() + 1 : 0);
 	}
 
-	void Decoder::nextLuminanceBlock(int *dctRecon)
+	/// Waits for the oldest pending pictures to be reconstructed and sends them to the renderer until
+	/// at most the given number remain pending.
+	void Decoder::flushPendingPictures(int maximumPending)
 	{
-		for (int i = 0; i < 64; ++i) 
+		while (m_pendingPictures.count() > qMax(maximumPending, 0))
 		{
-			int index = s_scanMatrix[i];
-			dctRecon[i] = (m_dctZigzag[index] * m_quantizerScale * m_intraQuantizerMatrix[i]) >> 3;
+			VideoPicture *picture = m_pendingPictures.takeFirst();
+			picture->waitForDecodedRows(picture->luma().blocks().height());
 
-			if ((dctRecon[i] & 1) == 0) 
-			{
-				dctRecon[i] -= sign(dctRecon[i]);
-
-				if (dctRecon[i] > 2047) 
-					dctRecon[i] = 2047;
+			// Once the consumer cancels, the next step stops decoding
+			if (!m_queue)
+				renderPicture(picture);
+			else if (!m_queue->push(picture))
+				m_cancelled.fetchAndStoreOrdered(1);
 
-				if (dctRecon[i] < -2048) 
-					dctRecon[i] = -2048;
-			}
+			picture->release();
 		}
-
-		dctRecon[0] = m_dctDcYPast + (m_dctZigzag[0] << 3);
-
-		m_dctDcYPast = dctRecon[0];
 	}
 
-	void Decoder::cbBlock(int *dctRecon)
+	/// Sends a reconstructed picture to the renderer, written into its own buffer if it offers one
+	void Decoder::renderPicture(const VideoPicture *picture)
 	{
-		for (int i = 0; i < 64; ++i) 
-		{
-			int index = s_scanMatrix[i];
-			dctRecon[i] = (m_dctZigzag[index] * m_quantizerScale * m_intraQuantizerMatrix[i]) >> 3;
-
-			if ((dctRecon[i] & 1) == 0) 
-			{
-				dctRecon[i] -= sign(dctRecon[i]);
-
-				if (dctRecon[i] > 2047) 
-					dctRecon[i] = 2047;
+		VideoBuffer buffer;
 
-				if (dctRecon[i] < -2048) 
-					dctRecon[i] = -2048;
-			}
+		if (m_renderer->acquireBuffer(picture, picture->pictureType(), buffer))
+		{
+			buffer.write(*picture, outputSize());
+			m_renderer->pushBuffer(buffer, picture->pictureType());
 		}
-
-		dctRecon[0] = m_dctZigzag[0] << 3;
-
-		if (m_macroblockAddress - m_pastIntraAddress > 1)
-			dctRecon[0] += 1024;
 		else
-			dctRecon[0] += m_dctDcCbPast;
-
-		m_dctDcCbPast = dctRecon[0];
+			m_renderer->pushPicture(picture, picture->pictureType());
 	}
 
-	void Decoder::crBlock(int *dctRecon)
+	/// Returns the size of the pictures given to the renderer
+	QSize Decoder::outputSize() const
 	{
-		for (int i = 0; i < 64; ++i) 
-		{
-			int index = s_scanMatrix[i];
-			dctRecon[i] = (m_dctZigzag[index] * m_quantizerScale * m_intraQuantizerMatrix[i]) >> 3;
-
-			if ((dctRecon[i] & 1) == 0) 
-			{
-				dctRecon[i] -= sign(dctRecon[i]);
-
-				if (dctRecon[i] > 2047) 
-					dctRecon[i] = 2047;
-
-				if (dctRecon[i] < -2048) 
-					dctRecon[i] = -2048;
-			}
-		}
+		int round = (1 << m_resolution) - 1;
 
-		dctRecon[0] = m_dctZigzag[0] << 3;
+		return QSize((m_width + round) >> m_resolution, (m_height + round) >> m_resolution);
+	}
 
-		if (m_macroblockAddress - m_pastIntraAddress > 1)
-			dctRecon[0] += 1024;
-		else
-			dctRecon[0] += m_dctDcCrPast;
+	void Decoder::releaseAnchors()
+	{
+		if (m_previousPicture)
+			m_previousPicture->release();
+		if (m_futurePicture)
+			m_futurePicture->release();
 
-		m_dctDcCrPast = dctRecon[0];
+		m_previousPicture = m_futurePicture = 0;
 	}
 }
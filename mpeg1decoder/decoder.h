@@ -2,8 +2,12 @@
 #define MPEG1_DECODER_H
 
 #include <QtCore/Qt>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSize>
 
-#include "vlc.h"
+#include "executor.h"
 
 namespace Mpeg1
 {
@@ -28,37 +32,243 @@ namespace Mpeg1
 	///     Original port. It compiles and runs. I have not yet analyzed the output.
 	class Decoder
 	{
-		// Start codes are reserved bit patterns that do not otherwise 
-		// occur in the video stream. All start codes are byte aligned.
-		static const int StartCode = 0x000001;		// 24-bit code
-
-		static const int PictureStartCode = 0x00000100;
-		static const int SliceStartCode = 0x00000101;	// through 0x000001af
-
-		static const int UserDataStartCode = 0x000001b2;
-		static const int SequenceHeaderCode = 0x000001b3;
-		static const int ExtensionStartCode = 0x000001b5;
-		static const int SequenceEndCode = 0x000001b7;
-		static const int GroupStartCode = 0x000001b8;
-
 	public:
+		/// Selects the pictures which are decoded and output
+		enum DecodePolicy
+		{
+			DecodeAllPictures,			//< Every picture
+			DecodeIntraPictures,		//< I (and D) pictures only. P and B pictures are skipped.
+			DecodeAnchorPictures,		//< I and P pictures. B pictures are skipped.
+			DecodeDecimated				//< About as many pictures per second as setTargetPictureRate() gives
+		};
+
+		/// The size of the decoded pictures relative to the coded size. The value of each is the
+		/// number of times the width and height are halved.
+		enum Resolution
+		{
+			FullResolution = 0,			//< Every sample
+			HalfResolution = 1,			//< 4x4 samples per 8x8 block, from its lowest 4x4 frequencies
+			QuarterResolution = 2,		//< 2x2 samples per 8x8 block, from its lowest 2x2 frequencies
+			EighthResolution = 3		//< One sample per 8x8 block, from its DC coefficient only
+		};
+
+		/// The outcome of a decoding step
+		enum DecodeStatus
+		{
+			SliceDecoded,				//< A slice of the picture being decoded was parsed and more are left
+			PictureDecoded,				//< A picture was decoded, stepped over or handed to a worker
+			EndOfStream,				//< The stream has ended and every picture has been output
+			Cancelled					//< cancel() stopped decoding
+		};
+
+		/// How seekToFrame() and seekToTime() find where to start decoding
+		enum SeekMode
+		{
+			IndexedSeek,				//< From a StartCodeIndex of the whole stream, built on the first seek
+			ApproximateSeek				//< By bisection on the group time codes, reading only a few windows (see GroupLocator)
+		};
 
 		/// Constructs MPEG decoder
 		///
-		/// \param queue  Playout queue
+		/// \param queue  Playout queue. When given, decoded pictures are pushed to it instead of the
+		///               renderer, so they can be consumed on another thread, and it is closed at the
+		///               end of the stream and reopened when a seek starts decoding again. Decoding
+		///               stops if the consumer cancels it. The renderer still receives the stream
+		///               parameters.
 		/// \param input  Video bitstream
 		/// \param player Canvas canvas
 		Decoder(class PictureQueue *queue, class InputBitstream *input, class VideoRenderer *renderer);
 
 		~Decoder();
 
+		/// Parses the first sequence header and allocates what decoding it needs, ahead of start(),
+		/// so that the first picture comes out with a predictable latency, as when switching channels.
+		///
+		/// Every picture decoding will use is taken from the pool up front, with its pages written
+		/// so the first pictures don't fault them in, and the variable length code tables are read
+		/// into the cache. start() then carries on from the sequence header without parsing it again.
+		/// The renderer is given the stream parameters here rather than in start().
+		///
+		/// Call it after the options (threads, resolution, luma only, anchor cache) and any seek are
+		/// set, and before start(). Must not be called while decoding.
+		///
+		/// \return false if the input is not at a sequence header
+		bool prepare();
+
+		/// Decodes to the end of the stream, or until cancel() is called. This is decodeNextPicture()
+		/// until it returns anything but PictureDecoded.
 		void start();
 
+		/// Decodes up to the end of the next picture, along with the headers before it.
+		///
+		/// Decoding is a sequence of steps rather than one call lasting the whole stream, so a
+		/// caller can interleave other work, multiplex many decoders on one thread or bound the
+		/// decoding done per display refresh. Pictures are output from within the steps as they
+		/// become due, as with start(). A picture handed to a worker may still be reconstructing
+		/// when the step returns.
+		///
+		/// After EndOfStream or Cancelled every further step returns EndOfStream, until a seek
+		/// starts decoding again.
+		DecodeStatus decodeNextPicture();
+
+		/// Same as decodeNextPicture() with at most a single slice of a picture parsed per step, for
+		/// a finer bound on the time taken. The I and P pictures, and the B pictures when decoding on
+		/// the calling thread, are parsed over several steps. Returns SliceDecoded while slices of
+		/// the current picture are left.
+		DecodeStatus decodeNextSlice();
+
+		/// Stops decoding at the next step boundary, which may be called from any thread.
+		///
+		/// The next step drops the picture being decoded and every picture not yet output, closes the
+		/// picture queue and returns Cancelled. start() returns at that point. A cancel which no step
+		/// has seen yet is forgotten by a successful seekToFrame() or prepare().
+		void cancel();
+
+		/// Sets the number of worker threads of a private Executor used for decoding.
+		///
+		/// Decoding is split into a parsing stage (PictureDecoder) and a reconstruction stage
+		/// (Reconstructor). With at least one thread, I and P pictures are parsed on the thread calling
+		/// start() and each of their macroblock rows is reconstructed on a worker as soon as it has
+		/// been parsed, so the pixel work is spread over the cores even when a picture is a single
+		/// slice. B pictures are never used as references, so each of them is parsed and reconstructed
+		/// on a worker. Pictures are still sent to the renderer from the thread calling start() and in
+		/// display order. A count of 0 decodes every picture on the calling thread.
+		///
+		/// This replaces any executor given to setExecutor().
+		///
+		/// By default there is no executor and every picture is decoded on the calling thread, so a
+		/// decoder costs no threads until it is given some. Must not be called while decoding.
+		///
+		/// \param threadCount the number of worker threads
+		void setThreadCount(int threadCount);
+
+		/// Returns the number of worker threads used for decoding
+		int threadCount() const;
+
+		/// Runs the decoding tasks on a shared executor instead of a private one.
+		///
+		/// Many decoders running at the same time should share Executor::globalInstance(), so that
+		/// the cores are shared between them rather than each decoder having its own threads. The
+		/// decoder submits its rows and B pictures through its own Executor::Stream.
+		///
+		/// Must not be called while decoding.
+		///
+		/// \param executor the executor, which must outlive the decoder. 0 decodes on the calling thread.
+		/// \param priority the priority of this decoder's tasks over other streams of the executor
+		/// \param weight the share of worker time of this decoder relative to streams of the same priority
+		void setExecutor(Executor *executor, int priority = 0, int weight = 1);
+
+		/// Returns the executor used for decoding, or 0 when decoding on the calling thread
+		Executor *executor() const;
+
+		/// Sets which pictures are decoded, for scrubbing, thumbnailing or analysis at a reduced rate.
+		///
+		/// Pictures which are not needed are stepped over by searching for the next start code,
+		/// without parsing their slices. Anchors are only decoded when a picture which is output may
+		/// predict from them : P pictures are skipped along with B pictures when only I pictures are
+		/// wanted. When decimating, a streaming decoder can't tell whether a later picture will
+		/// predict from an anchor, so every anchor is decoded but only those due are output, and B
+		/// pictures which are not due are skipped.
+		///
+		/// The default decodes every picture. Must not be called while decoding.
+		void setDecodePolicy(DecodePolicy policy);
+
+		DecodePolicy decodePolicy() const;
+
+		/// Sets the number of pictures per second output by the DecodeDecimated policy.
+		///
+		/// A picture is output when it is the first one of a period of 1 / picturesPerSecond
+		/// seconds of the stream, counting in display order from the start of the stream.
+		void setTargetPictureRate(qreal picturesPerSecond);
+
+		qreal targetPictureRate() const;
+
+		/// Sets the size the pictures are decoded at, for displays and previews smaller than the
+		/// stream, rather than decoding every sample and scaling the pictures down afterwards.
+		///
+		/// Each block is reduced to its lowest frequencies : the other coefficients are stepped over
+		/// without being dequantized, a smaller inverse DCT makes the samples of the reduced block
+		/// (none at all at EighthResolution, which only keeps the DC coefficient), and motion is
+		/// compensated on the reduced pictures with the vectors scaled down. The pictures, and the
+		/// work of reconstructing them, shrink with the square of the reduction. Prediction from the
+		/// reduced anchors drifts from the full size pictures until the next I picture.
+		///
+		/// The renderer is given the reduced size, rounded up. The default is FullResolution. Must
+		/// not be called while decoding.
+		void setResolution(Resolution resolution);
+
+		Resolution resolution() const;
+
+		/// Decodes the luma plane only, for grayscale display or analysis.
+		///
+		/// The chroma blocks are stepped over without being dequantized, and the chroma planes are
+		/// never predicted or transformed. The pictures have constant chroma planes of neutral
+		/// samples taking a single line of memory (see VideoPicture::allocate()), so they still read
+		/// and convert as grayscale pictures.
+		///
+		/// The default decodes every plane. Must not be called while decoding.
+		void setLumaOnly(bool lumaOnly);
+
+		bool lumaOnly() const;
+
+		/// Makes the next start() decode from a frame, counting in display order from the start of
+		/// the stream, rather than from the current position of the input.
+		///
+		/// The input device must be seekable. The first seek indexes the start codes of the stream
+		/// (see setSeekMode()), and each seek then jumps to the group of pictures holding the frame,
+		/// or to the group before it when the frame is a leading B picture of an open group. Only the
+		/// anchors the frame may predict from are decoded : the B pictures before the frame are
+		/// stepped over without parsing their slices, and no picture before the frame is output. The
+		/// work of a seek is bounded by the length of a group of pictures rather than by the position
+		/// of the frame in the file.
+		///
+		/// start() or the next step then decodes from the frame. May be called between two steps,
+		/// dropping what they had not output, but not during start().
+		///
+		/// \return false if the input can't be indexed or the stream has no such frame
+		bool seekToFrame(int frame);
+
+		/// Same as seekToFrame() for the frame displayed at a time, in seconds from the start of
+		/// the stream at the picture rate of its first sequence header
+		bool seekToTime(qreal seconds);
+
+		/// Sets how seeks find where to start decoding.
+		///
+		/// Indexing reads the whole stream before the first seek, which takes long on very large
+		/// files. ApproximateSeek opens them with a few reads instead, and its seeks are as accurate
+		/// as the time codes of the stream, which number the frames (see GroupLocator).
+		///
+		/// The default is IndexedSeek. Must not be called while decoding.
+		void setSeekMode(SeekMode mode);
+
+		SeekMode seekMode() const;
+
+		/// Keeps the decoded I picture starting each of the most recently decoded groups of pictures,
+		/// so that seeking again near them doesn't decode them again. Each cached picture is held
+		/// from the picture pool until it leaves the cache.
+		///
+		/// The default of 0 caches nothing. Must not be called while decoding.
+		///
+		/// \param groups the number of groups of pictures whose I picture is kept
+		void setAnchorCacheSize(int groups);
+
+		int anchorCacheSize() const;
+
 	private:
 		void nextStartCode();
 	
+		void beginStream();
+
+		void beginSequence();
+
+		void endStream();
+
+		void reset();
+
 		void parseSequenceHeader();
 
+		void configureSequence();
+
 		void parseGroupOfPictures();
 
 		void loadIntraQuantizerMatrix();
@@ -71,88 +281,135 @@ namespace Mpeg1
 
 		void parsePicture();
 
-		void parseSlice();
+		bool isPictureWanted(int pictureType, int temporalReference) const;
+
+		DecodeStatus decodeSlice();
+
+		void endPicture();
+
+		void skipPicture();
+
+		void skipOutput(int pictureType, int temporalReference);
+
+		void dispatchPicture();
+
+		void pushPicture(class VideoPicture *picture);
+
+		void flushPendingPictures(int maximumPending = 0);
+
+		void renderPicture(const class VideoPicture *picture);
+
+		QSize outputSize() const;
+
+		void releaseAnchors();
 
-		void parseMacroblock();
+		bool buildIndex();
 
-		void parseBlock(int index);
+		int firstPictureRate();
 
-		static int sign(int n);
+		class VideoPicture *cachedAnchor(qint64 groupOffset);
 
-		void firstLuminanceBlock(int *dctRecon);
+		void cacheAnchor(qint64 groupOffset, class VideoPicture *picture);
 
-		void nextLuminanceBlock(int *dctRecon);
+		void clearAnchorCache();
 
-		void cbBlock(int *dctRecon);
+		void startThreads(int priority, int weight);
 
-		void crBlock(int *dctRecon);
+		void stopThreads();
 
 	private:
 		class PictureQueue *m_queue;
+		bool m_queueClosed;		//< The queue is reopened when decoding starts again
 		class InputBitstream *m_input;
 		class VideoRenderer *m_renderer;
 
-		class VideoPicture *m_videoPictureStore[3];
+		class PicturePool *m_picturePool;
+		class PictureDecoder *m_pictureDecoder;
+
+		// Anchors in display order. I and P pictures predict from the most recent of the two, which
+		// is m_futurePicture. Each anchor holds a reference to the picture.
 		class VideoPicture *m_currentPicture;
 		class VideoPicture *m_previousPicture;
 		class VideoPicture *m_futurePicture;
-		int m_current;
-		int m_previous;
-		int m_future;
 
-		int m_vbvBufferSize;			// Sequence Header : Provided for informative reasons
+		// B pictures and the rows of I and P pictures are run on m_stream
+		Executor *m_executor;
+		bool m_ownsExecutor;
+		Executor::Stream *m_stream;
+		class RowScheduler *m_rowScheduler;
+
+		// Pictures waiting to be sent to the renderer, in display order. Each holds a reference.
+		class DisplayOrder *m_displayOrder;
+		QList<class VideoPicture *> m_pendingPictures;
+		bool m_firstOfGroup;
+		bool m_closedGroup;
 
-		class MotionVector *m_forward;
-		class MotionVector *m_backward;
+		// prepare() has parsed the first sequence header for start()
+		bool m_prepared;
+
+		int m_vbvBufferSize;			// Sequence Header : Provided for informative reasons
 
 		int m_pictureCodingType;		// TODO : Convert to enum
+		int m_pictureRate;
 
-		int m_width;
-		int m_height;
+		DecodePolicy m_decodePolicy;
+		qreal m_targetPictureRate;
 
-		int m_macroblockWidth;
-		int m_macroblockHeight;
+		// Display number of the first picture of the current group, and the pictures seen in it
+		int m_groupFirstPicture;
+		int m_groupPictures;
 
-		int m_macroblockRow;
-		int m_macroblockColumn;
+		// The current picture is only decoded for the pictures predicting from it
+		bool m_outputCurrent;
 
-		static const short s_defaultIntraQuantizerMatrix[];
-		static const short s_defaultNonIntraQuantizerMatrix[];
+		// The current picture is the I picture of a group, cached once all its slices are parsed
+		bool m_cacheCurrent;
 
-		short m_intraQuantizerMatrix[64];
-		short m_nonIntraQuantizerMatrix[64];
+		// Start codes of the stream, indexed on the first seek, or the locator of approximate seeks
+		SeekMode m_seekMode;
+		class StartCodeIndex *m_index;
+		class GroupLocator *m_locator;
 
-		static const quint8 s_scanMatrix[];
+		// The frame sought, before which no picture is output, or -1. The group decoding starts at
+		// and the sequence header in effect for it are pending until the next start().
+		int m_seekFrame;
+		qint64 m_seekSequenceHeader;
+		qint64 m_seekGroup;
+		int m_seekGroupFirstFrame;
 
-		// Only present in P and B pictures
-		int m_forwardF;
-		int m_forwardRSize;
+		// Byte offset of the current group, and the first I picture of recently decoded groups by
+		// their offset, least recently used first. Each cached picture holds a reference.
+		qint64 m_groupOffset;
+		int m_anchorCacheSize;
+		QList<QPair<qint64, class VideoPicture *> > m_anchorCache;
 
-		// Only present in B pictures
-		int m_backwardF;
-		int m_backwardRSize;
+		// Where the steps are in the stream, and the picture whose slices are left to them
+		enum State
+		{
+			StateBegin,
+			StateDecoding,
+			StateEnded
+		};
 
-		// Predictors
-		int m_dctDcYPast;
-		int m_dctDcCbPast;
-		int m_dctDcCrPast;
+		State m_state;
+		class MacroblockBatch *m_batch;
 
-		int m_pastIntraAddress;
-		int m_macroblockAddress;
-		int m_quantizerScale;
+		QAtomicInt m_cancelled;
 
-		// Used for decoding motion vectors
-		int m_motionHorizontalForwardR;
-		int m_motionVerticalForwardR;
+		Resolution m_resolution;
+		bool m_lumaOnly;
 
-		int m_motionHorizontalBackwardR;
-		int m_motionVerticalBackwardR;
+		int m_width;
+		int m_height;
 
-		Vlc::MacroblockType m_macroblockType;
+		int m_macroblockWidth;
+		int m_macroblockHeight;
 
-		static int s_nullMatrix[64];
-		int m_dctRecon[64];
-		int m_dctZigzag[64];
+		static const short s_defaultIntraQuantizerMatrix[];
+		static const short s_defaultNonIntraQuantizerMatrix[];
+
+		short m_intraQuantizerMatrix[64];
+		short m_nonIntraQuantizerMatrix[64];
 	};
 }
 
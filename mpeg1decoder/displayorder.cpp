@@ -0,0 +1,89 @@
+#include "displayorder.h"
+#include "videopicture.h"
+
+namespace Mpeg1
+{
+	// temporal_reference is a 10 bit counter
+	static const int TemporalReferenceMask = 0x3ff;
+
+	DisplayOrder::DisplayOrder() :
+		m_heldPicture(0),
+		m_nextTemporalReference(0)
+	{
+	}
+
+	DisplayOrder::~DisplayOrder()
+	{
+		clear();
+	}
+
+	void DisplayOrder::push(VideoPicture *picture, bool firstOfGroup, QList<VideoPicture *> &output)
+	{
+		// Every picture of the previous group is displayed before the new group
+		if (firstOfGroup)
+		{
+			flush(output);
+			m_nextTemporalReference = 0;
+		}
+
+		if (picture->pictureType() == VideoPicture::PictureCodingB)
+		{
+			output.append(picture);
+			m_nextTemporalReference = (picture->temporalReference() + 1) & TemporalReferenceMask;
+
+			releaseDue(output);
+			return;
+		}
+
+		// The anchor is displayed after the one held, whatever the temporal references say
+		flush(output);
+
+		m_heldPicture = picture;
+		releaseDue(output);
+	}
+
+	void DisplayOrder::skip(int pictureType, int temporalReference, bool firstOfGroup, QList<VideoPicture *> &output)
+	{
+		if (firstOfGroup)
+		{
+			flush(output);
+			m_nextTemporalReference = 0;
+		}
+
+		// A skipped anchor is still displayed after the one held
+		if (pictureType != VideoPicture::PictureCodingB)
+			flush(output);
+
+		m_nextTemporalReference = (temporalReference + 1) & TemporalReferenceMask;
+		releaseDue(output);
+	}
+
+	void DisplayOrder::flush(QList<VideoPicture *> &output)
+	{
+		if (m_heldPicture)
+			release(output);
+	}
+
+	void DisplayOrder::clear()
+	{
+		if (m_heldPicture)
+			m_heldPicture->release();
+
+		m_heldPicture = 0;
+	}
+
+	void DisplayOrder::release(QList<VideoPicture *> &output)
+	{
+		m_nextTemporalReference = (m_heldPicture->temporalReference() + 1) & TemporalReferenceMask;
+
+		output.append(m_heldPicture);
+		m_heldPicture = 0;
+	}
+
+	/// Releases the held anchor if every picture displayed before it has gone by
+	void DisplayOrder::releaseDue(QList<VideoPicture *> &output)
+	{
+		if (m_heldPicture && m_heldPicture->temporalReference() == m_nextTemporalReference)
+			release(output);
+	}
+}
@@ -0,0 +1,62 @@
+#if !defined(MPEG1_DISPLAYORDER_H)
+#define MPEG1_DISPLAYORDER_H
+
+#include <QtCore/QList>
+
+namespace Mpeg1
+{
+	/// Puts pictures from bitstream order back into display order.
+	///
+	/// An anchor (I or P picture) is coded ahead of the B pictures which are displayed before it, so
+	/// it has to be held back until they have gone by. B pictures are never held. The temporal
+	/// reference of each picture tells when the held anchor is due, so it is released right after
+	/// the last B picture before it rather than when the next anchor arrives. Streams without B
+	/// pictures therefore go through without any delay, and at most one picture is ever held.
+	///
+	/// A new group of pictures restarts the temporal references. If they don't add up, because of
+	/// a broken stream or a stream edited without renumbering, an anchor is released at the latest
+	/// when the next anchor arrives, as in ISO/IEC 11172-2 2.4.1.
+	class DisplayOrder
+	{
+	public:
+		DisplayOrder();
+
+		/// Destructor. Releases the held picture
+		~DisplayOrder();
+
+		/// Takes the next picture in bitstream order
+		///
+		/// \param picture the picture. Its reference is taken over by the display order.
+		/// \param firstOfGroup true for the first picture after a group of pictures header
+		/// \param output receives the pictures which are due, in display order, with their references
+		void push(class VideoPicture *picture, bool firstOfGroup, QList<class VideoPicture *> &output);
+
+		/// Accounts for a picture which is not output, so the pictures displayed after it are not
+		/// held back waiting for it.
+		///
+		/// \param pictureType the picture coding type of the picture
+		/// \param temporalReference the temporal reference of the picture
+		/// \param firstOfGroup true for the first picture after a group of pictures header
+		/// \param output receives the pictures which are due, in display order, with their references
+		void skip(int pictureType, int temporalReference, bool firstOfGroup, QList<class VideoPicture *> &output);
+
+		/// Releases the held picture to the output. Called at the end of the stream.
+		void flush(QList<class VideoPicture *> &output);
+
+		/// Drops the held picture
+		void clear();
+
+	private:
+		void release(QList<class VideoPicture *> &output);
+
+		void releaseDue(QList<class VideoPicture *> &output);
+
+	private:
+		Q_DISABLE_COPY(DisplayOrder)
+
+		class VideoPicture *m_heldPicture;
+		int m_nextTemporalReference;
+	};
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "executor.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+
+namespace Mpeg1
+{
+	/// One worker of an executor
+	class ExecutorThread : public QThread
+	{
+	public:
+		ExecutorThread(Executor *executor, int worker) :
+			m_executor(executor),
+			m_worker(worker)
+		{
+		}
+
+	protected:
+		void run()
+		{
+			m_executor->work(m_worker);
+		}
+
+	private:
+		Executor *m_executor;
+		int m_worker;
+	};
+
+	Q_GLOBAL_STATIC(Executor, globalExecutor)
+
+	Executor::Stream::Stream(Executor *executor, int priority, int weight) :
+		m_executor(executor),
+		m_priority(priority),
+		m_weight(qMax(weight, 1)),
+		m_running(0),
+		m_virtualTime(0),
+		m_home(0)
+	{
+		m_executor->addStream(this);
+	}
+
+	Executor::Stream::~Stream()
+	{
+		m_executor->removeStream(this);
+	}
+
+	Executor *Executor::Stream::executor() const
+	{
+		return m_executor;
+	}
+
+	void Executor::Stream::setPriority(int priority)
+	{
+		QMutexLocker locker(&m_executor->m_mutex);
+		m_priority = priority;
+	}
+
+	int Executor::Stream::priority() const
+	{
+		QMutexLocker locker(&m_executor->m_mutex);
+		return m_priority;
+	}
+
+	void Executor::Stream::setWeight(int weight)
+	{
+		QMutexLocker locker(&m_executor->m_mutex);
+		m_weight = qMax(weight, 1);
+	}
+
+	int Executor::Stream::weight() const
+	{
+		QMutexLocker locker(&m_executor->m_mutex);
+		return m_weight;
+	}
+
+	void Executor::Stream::start(QRunnable *runnable)
+	{
+		m_executor->queue(this, runnable);
+	}
+
+	void Executor::Stream::waitForDone()
+	{
+		QMutexLocker locker(&m_executor->m_mutex);
+		while(!m_tasks.isEmpty() || m_running > 0)
+			m_done.wait(&m_executor->m_mutex);
+	}
+
+	Executor::Executor(int threadCount) :
+		m_nextHome(0),
+		m_idle(0),
+		m_stopping(false)
+	{
+		if(threadCount <= 0)
+			threadCount = QThread::idealThreadCount();
+
+		for(int i = 0; i < threadCount; i++)
+			m_streams.append(QList<Stream *>());
+
+		for(int i = 0; i < threadCount; i++)
+		{
+			ExecutorThread *thread = new ExecutorThread(this, i);
+			m_threads.append(thread);
+			thread->start();
+		}
+	}
+
+	Executor::~Executor()
+	{
+		{
+			QMutexLocker locker(&m_mutex);
+			m_stopping = true;
+			m_workAvailable.wakeAll();
+		}
+
+		while(!m_threads.isEmpty())
+		{
+			ExecutorThread *thread = m_threads.takeFirst();
+			thread->wait();
+			delete thread;
+		}
+	}
+
+	Executor *Executor::globalInstance()
+	{
+		return globalExecutor();
+	}
+
+	int Executor::threadCount() const
+	{
+		return m_threads.count();
+	}
+
+	/// Gives a new stream a home and lets it start on an equal footing with the streams already
+	/// running, rather than with the time they have used so far.
+	void Executor::addStream(Stream *stream)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		bool first = true;
+		for(int i = 0; i < m_streams.count(); i++)
+		{
+			for(int j = 0; j < m_streams.at(i).count(); j++)
+			{
+				const Stream *other = m_streams.at(i).at(j);
+				if(first || other->m_virtualTime < stream->m_virtualTime)
+					stream->m_virtualTime = other->m_virtualTime;
+				first = false;
+			}
+		}
+
+		stream->m_home = m_nextHome;
+		m_nextHome = (m_nextHome + 1) % m_streams.count();
+
+		m_streams[stream->m_home].append(stream);
+	}
+
+	void Executor::removeStream(Stream *stream)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		while(!stream->m_tasks.isEmpty() || stream->m_running > 0)
+			stream->m_done.wait(&m_mutex);
+
+		m_streams[stream->m_home].removeOne(stream);
+	}
+
+	void Executor::queue(Stream *stream, QRunnable *runnable)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		stream->m_tasks.enqueue(runnable);
+
+		if(m_idle > 0)
+			m_workAvailable.wakeOne();
+	}
+
+	/// The loop of every worker thread. Returns once the executor is stopping and no task is left.
+	void Executor::work(int worker)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		for(;;)
+		{
+			Stream *stream = nextStream(worker);
+			if(!stream)
+			{
+				if(m_stopping)
+					return;
+
+				m_idle++;
+				m_workAvailable.wait(&m_mutex);
+				m_idle--;
+				continue;
+			}
+
+			QRunnable *runnable = stream->m_tasks.dequeue();
+			stream->m_running++;
+
+			locker.unlock();
+
+			QElapsedTimer timer;
+			timer.start();
+
+			bool autoDelete = runnable->autoDelete();
+			runnable->run();
+			if(autoDelete)
+				delete runnable;
+
+			qint64 elapsed = timer.nsecsElapsed();
+
+			locker.relock();
+
+			stream->m_virtualTime += elapsed / stream->m_weight;
+			stream->m_running--;
+
+			if(stream->m_tasks.isEmpty() && stream->m_running == 0)
+				stream->m_done.wakeAll();
+		}
+	}
+
+	/// Picks the stream a worker should run a task of next, or 0 if there is nothing to run.
+	///
+	/// The worker serves its own deque unless another deque holds a stream of higher priority or
+	/// its own deque has nothing to run.
+	Executor::Stream *Executor::nextStream(int worker)
+	{
+		Stream *best = 0;
+
+		const QList<Stream *> &own = m_streams.at(worker);
+		for(int i = 0; i < own.count(); i++)
+		{
+			Stream *stream = own.at(i);
+			if(!stream->m_tasks.isEmpty() && (!best || isBefore(stream, best)))
+				best = stream;
+		}
+
+		Stream *stolen = 0;
+		for(int i = 0; i < m_streams.count(); i++)
+		{
+			if(i == worker)
+				continue;
+
+			const QList<Stream *> &other = m_streams.at(i);
+			for(int j = 0; j < other.count(); j++)
+			{
+				Stream *stream = other.at(j);
+				if(stream->m_tasks.isEmpty())
+					continue;
+
+				if(best && stream->m_priority <= best->m_priority)
+					continue;
+
+				if(!stolen || isBefore(stream, stolen))
+					stolen = stream;
+			}
+		}
+
+		if(!stolen)
+			return best;
+
+		// Move the stream here unless its home worker is busy with it, in which case its data is
+		// still in the caches over there
+		if(stolen->m_running == 0)
+		{
+			m_streams[stolen->m_home].removeOne(stolen);
+			m_streams[worker].append(stolen);
+			stolen->m_home = worker;
+		}
+
+		return stolen;
+	}
+
+	/// Returns true if a stream should be served before another one
+	bool Executor::isBefore(const Stream *stream, const Stream *other)
+	{
+		if(stream->m_priority != other->m_priority)
+			return stream->m_priority > other->m_priority;
+
+		return stream->m_virtualTime < other->m_virtualTime;
+	}
+}
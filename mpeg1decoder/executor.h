@@ -0,0 +1,127 @@
+#if !defined(MPEG1_EXECUTOR_H)
+#define MPEG1_EXECUTOR_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QWaitCondition>
+
+class QRunnable;
+
+namespace Mpeg1
+{
+	/// A pool of worker threads shared by any number of decoders.
+	///
+	/// Running a pool of threads per decoder oversubscribes the cores as soon as more than a few
+	/// streams are decoded at once. Instead every decoder can submit its tasks to one executor
+	/// through its own Stream, and the executor shares its workers between the streams.
+	///
+	/// Scheduling works on streams :
+	///   - The tasks of a stream are started in the order they were submitted. Decoder tasks wait on
+	///     tasks submitted before them in the same stream, never after, so this is what guarantees
+	///     that waiting tasks can't take every worker and deadlock.
+	///   - A stream of higher priority always goes first. Between streams of the same priority the
+	///     worker time is shared in proportion to their weight, by running the stream which has used
+	///     the least time relative to its weight.
+	///   - Every stream has a home worker, which keeps the stream's tasks and data in that core's
+	///     caches. A worker looks at the streams of its own deque first, and only when it has nothing
+	///     to do it steals from the deques of the other workers, taking the stream home with it.
+	///
+	/// The task sizes used by the decoder (a macroblock row, a B picture) are large enough that all
+	/// this is done under a single lock.
+	class Executor
+	{
+	public:
+		/// The tasks of one decoder
+		class Stream
+		{
+		public:
+			/// Constructs a stream
+			///
+			/// \param executor runs the tasks of the stream
+			/// \param priority streams of higher priority are always served first
+			/// \param weight the share of worker time relative to the other streams of the same priority
+			Stream(Executor *executor, int priority = 0, int weight = 1);
+
+			/// Destructor. Waits for every task of the stream to be run
+			~Stream();
+
+			/// Returns the executor running the stream
+			Executor *executor() const;
+
+			void setPriority(int priority);
+
+			int priority() const;
+
+			void setWeight(int weight);
+
+			int weight() const;
+
+			/// Queues a task. Like QThreadPool, the task is deleted after running if autoDelete() is set.
+			void start(QRunnable *runnable);
+
+			/// Blocks until every task submitted so far has been run
+			void waitForDone();
+
+		private:
+			Q_DISABLE_COPY(Stream)
+			friend class Executor;
+
+			Executor *m_executor;
+			int m_priority;
+			int m_weight;
+
+			// All of the following is protected by the executor mutex
+			QQueue<QRunnable *> m_tasks;
+			int m_running;				//< Tasks taken from m_tasks and still running
+			qint64 m_virtualTime;		//< Worker time used, divided by the weight
+			int m_home;					//< Index of the worker whose deque holds the stream
+			QWaitCondition m_done;
+		};
+
+		/// Constructs the executor
+		///
+		/// \param threadCount the number of worker threads. The number of cores when 0 or less.
+		Executor(int threadCount = 0);
+
+		/// Destructor. Waits for every task to be run. Every stream must be destroyed first.
+		~Executor();
+
+		/// Returns an executor with one worker per core, shared by the whole process
+		static Executor *globalInstance();
+
+		/// Returns the number of worker threads
+		int threadCount() const;
+
+	private:
+		Q_DISABLE_COPY(Executor)
+		friend class ExecutorThread;
+
+		void addStream(Stream *stream);
+
+		void removeStream(Stream *stream);
+
+		void queue(Stream *stream, QRunnable *runnable);
+
+		void work(int worker);
+
+		Stream *nextStream(int worker);
+
+		static bool isBefore(const Stream *stream, const Stream *other);
+
+	private:
+		QMutex m_mutex;
+		QWaitCondition m_workAvailable;
+
+		QList<class ExecutorThread *> m_threads;
+
+		// The deque of streams of each worker
+		QList<QList<Stream *> > m_streams;
+		int m_nextHome;
+
+		int m_idle;
+		bool m_stopping;
+	};
+}
+
+#endif
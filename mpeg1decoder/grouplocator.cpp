@@ -0,0 +1,227 @@
+#include "grouplocator.h"
+#include "startcodeindex.h"
+#include "startcodes.h"
+
+#include <QtCore/QVector>
+
+namespace Mpeg1
+{
+	// Bytes read at most to resynchronize on a group, enough for a group of pictures at a high bit rate
+	static const qint64 MaximumProbeLength = 4 << 20;
+
+	// The bisection stops once the span left is about what a single probe reads
+	static const qint64 MinimumSpan = 1 << 16;
+
+	static const int MaximumProbes = 64;
+
+	// Whole pictures per second of each picture_rate code, as time codes count them
+	static const int s_timeCodeRates[] = { 0, 24, 24, 25, 30, 30, 50, 60, 60 };
+
+	GroupLocator::GroupLocator(QIODevice *device) :
+		m_device(device),
+		m_opened(false),
+		m_pictureRate(0),
+		m_bitRate(0),
+		m_firstTimeCodeFrame(0)
+	{
+	}
+
+	int GroupLocator::pictureRate()
+	{
+		qint64 position = m_device->pos();
+		bool opened = open();
+		m_device->seek(position);
+
+		return opened ? m_pictureRate : 0;
+	}
+
+	bool GroupLocator::locate(int frame, Location &location)
+	{
+		if(frame < 0)
+			return false;
+
+		// The device may be in the middle of being decoded
+		qint64 position = m_device->pos();
+		bool result = open() && locateGroup(frame, location);
+		m_device->seek(position);
+
+		return result;
+	}
+
+	bool GroupLocator::locateGroup(int frame, Location &location)
+	{
+		Probe best;
+		if(!find(frame, best))
+			return false;
+
+		// Past the last group the frame still has to be one of its pictures
+		int pictures;
+		if(countLastGroup(best.offset, pictures) && frame >= best.frame + pictures)
+			return false;
+
+		// The leading B pictures of an open group predict from the last anchor of the group before
+		if(!best.closed && frame < best.frame + best.leadingFrames && best.offset > m_first.offset)
+		{
+			if(!find(best.frame - 1, best))
+				return false;
+		}
+
+		location.sequenceHeader = best.sequenceHeader;
+		location.group = best.offset;
+		location.firstFrame = best.frame;
+		return true;
+	}
+
+	/// Reads the first sequence header and group of pictures, the first time it is needed
+	bool GroupLocator::open()
+	{
+		if(m_opened)
+			return true;
+
+		QVector<StartCodeIndex::Entry> entries;
+		int group = StartCodeIndex::scanToGroup(m_device, 0, MaximumProbeLength, entries);
+		if(group < 1 || entries.at(group - 1).code != StartCodes::SequenceHeaderCode)
+			return false;
+
+		const StartCodeIndex::Entry &sequenceHeader = entries.at(group - 1);
+		if(sequenceHeader.pictureRate < 1 || sequenceHeader.pictureRate > 8)
+			return false;
+
+		m_pictureRate = sequenceHeader.pictureRate;
+		m_bitRate = sequenceHeader.bitRate;
+		m_firstTimeCodeFrame = timeCodeFrame(entries.at(group).timeCode, m_pictureRate);
+
+		if(!probe(0, m_first))
+			return false;
+
+		m_opened = true;
+		return true;
+	}
+
+	/// Finds the first group of pictures after an offset
+	bool GroupLocator::probe(qint64 offset, Probe &probe)
+	{
+		QVector<StartCodeIndex::Entry> entries;
+		int group = StartCodeIndex::scanToGroup(m_device, offset, MaximumProbeLength, entries);
+		if(group < 0)
+			return false;
+
+		const StartCodeIndex::Entry &entry = entries.at(group);
+
+		probe.offset = entry.offset;
+		probe.sequenceHeader = -1;
+		if(group > 0 && entries.at(group - 1).code == StartCodes::SequenceHeaderCode)
+			probe.sequenceHeader = entries.at(group - 1).offset;
+
+		probe.frame = timeCodeFrame(entry.timeCode, m_pictureRate) - m_firstTimeCodeFrame;
+		probe.closed = entry.closedGop;
+
+		// The I picture coded first is displayed after the leading B pictures
+		probe.leadingFrames = 0;
+		if(group + 1 < entries.count() && entries.at(group + 1).code == StartCodes::PictureStartCode)
+			probe.leadingFrames = entries.at(group + 1).temporalReference;
+
+		return true;
+	}
+
+	/// Finds the last group whose time code is at or before a frame
+	bool GroupLocator::find(int frame, Probe &best)
+	{
+		best = m_first;
+
+		qint64 low = m_first.offset;
+		qint64 high = m_device->size();
+
+		// First guess from a constant bit rate, in units of 400 bits per second
+		qint64 guess = low + (high - low) / 2;
+		if(m_bitRate > 0 && m_bitRate != 0x3ffff)
+			guess = low + (qint64)(frame - m_first.frame) * m_bitRate * 50 / s_timeCodeRates[m_pictureRate];
+
+		for(int i = 0; i < MaximumProbes && high - low > MinimumSpan; i++)
+		{
+			guess = qBound(low + 1, guess, high - 1);
+
+			Probe probe;
+			if(this->probe(guess, probe) && probe.offset < high)
+			{
+				// Time codes which don't increase can't be bisected
+				if(probe.frame <= best.frame)
+					return false;
+
+				if(probe.frame > frame)
+					high = guess;
+				else
+				{
+					// Groups without a sequence header of their own use the last one seen before them
+					if(probe.sequenceHeader < 0)
+						probe.sequenceHeader = best.sequenceHeader;
+
+					best = probe;
+					low = probe.offset;
+				}
+			}
+			else
+				high = guess;
+
+			guess = low + (high - low) / 2;
+		}
+
+		// Step through the few groups left in the span
+		Probe next;
+		while(probe(best.offset + 4, next) && next.frame <= frame)
+		{
+			if(next.frame <= best.frame)
+				return false;
+
+			if(next.sequenceHeader < 0)
+				next.sequenceHeader = best.sequenceHeader;
+
+			best = next;
+		}
+
+		return true;
+	}
+
+	/// Counts the pictures of the group at an offset when it is the last group of the stream
+	///
+	/// \return false if another group follows it, or if the end of the stream is further than a probe reads
+	bool GroupLocator::countLastGroup(qint64 offset, int &pictures)
+	{
+		// Stops at the next group, so only the last group is read to the end
+		QVector<StartCodeIndex::Entry> entries;
+		if(StartCodeIndex::scanToGroup(m_device, offset + 4, MaximumProbeLength, entries) >= 0)
+			return false;
+
+		if(offset + 4 + MaximumProbeLength < m_device->size())
+			return false;
+
+		pictures = 0;
+		for(int i = 0; i < entries.count(); i++)
+		{
+			if(entries.at(i).code == StartCodes::PictureStartCode)
+				pictures++;
+		}
+
+		return true;
+	}
+
+	/// See ISO/IEC 11172-2 2.4.3.4
+	int GroupLocator::timeCodeFrame(int timeCode, int pictureRate)
+	{
+		bool dropFrame = (timeCode >> 24) & 0x1;
+		int hours = (timeCode >> 19) & 0x1f;
+		int minutes = (timeCode >> 13) & 0x3f;
+		int seconds = (timeCode >> 6) & 0x3f;
+		int pictures = timeCode & 0x3f;
+
+		int rate = (pictureRate > 0 && pictureRate < 9) ? s_timeCodeRates[pictureRate] : 0;
+		int totalMinutes = hours * 60 + minutes;
+		int frame = (totalMinutes * 60 + seconds) * rate + pictures;
+
+		// Drop frame time codes skip the first picture numbers of every minute but each tenth one
+		if(dropFrame && (rate == 30 || rate == 60))
+			frame -= (rate / 15) * (totalMinutes - totalMinutes / 10);
+
+		return frame;
+	}
+}
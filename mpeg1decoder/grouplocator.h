@@ -0,0 +1,82 @@
+#if !defined(MPEG1_GROUPLOCATOR_H)
+#define MPEG1_GROUPLOCATOR_H
+
+#include <QtCore/QIODevice>
+
+namespace Mpeg1
+{
+	/// Finds the group of pictures holding a frame without indexing the stream.
+	///
+	/// Where StartCodeIndex reads the whole stream once before the first seek, the locator only reads
+	/// a few small windows of it. It guesses the byte offset of the frame from the bit rate of the
+	/// first sequence header, or takes the middle of the file for a variable bit rate stream,
+	/// resynchronizes on the next group of pictures header after the guess (see
+	/// StartCodeIndex::scanToGroup()) and bisects on the time codes of the groups it lands on.
+	///
+	/// Frames are numbered from the time code of the first group, counting drop frame time codes.
+	/// This is only the numbering of StartCodeIndex when the first group is closed and the time
+	/// codes run without gaps. Streams whose time codes don't increase can't be located.
+	class GroupLocator
+	{
+	public:
+		/// Where decoding starts for a frame
+		struct Location
+		{
+			qint64 sequenceHeader;		//< Byte offset of the sequence header to decode the group with
+			qint64 group;				//< Byte offset of the group start code
+			int firstFrame;				//< Frame number of the picture with temporal reference 0
+		};
+
+		/// Constructs the locator
+		///
+		/// \param device the stream, which must be random access. Its position is restored after every call.
+		GroupLocator(QIODevice *device);
+
+		/// Returns the picture_rate code of the first sequence header, or 0 if there is none
+		int pictureRate();
+
+		/// Finds the group decoding must start at for a frame. That is the group holding it, or the
+		/// group before it when the frame is a leading B picture of an open group.
+		///
+		/// \return false if the stream has no such frame, including a frame past the pictures of the
+		///         last group, or can't be located
+		bool locate(int frame, Location &location);
+
+		/// Returns the number of pictures up to a group of pictures time code, counting drop frame
+		/// time codes, for a picture_rate code
+		static int timeCodeFrame(int timeCode, int pictureRate);
+
+	private:
+		/// A group of pictures found after some offset
+		struct Probe
+		{
+			qint64 offset;
+			qint64 sequenceHeader;		//< The sequence header right before the group, or -1
+			int frame;
+			int leadingFrames;
+			bool closed;
+		};
+
+		bool open();
+
+		bool locateGroup(int frame, Location &location);
+
+		bool probe(qint64 offset, Probe &probe);
+
+		bool find(int frame, Probe &best);
+
+		bool countLastGroup(qint64 offset, int &pictures);
+
+	private:
+		QIODevice *m_device;
+
+		bool m_opened;
+		int m_pictureRate;
+		int m_bitRate;
+		int m_firstTimeCodeFrame;
+
+		Probe m_first;
+	};
+}
+
+#endif
@@ -2,6 +2,20 @@
 
 namespace Mpeg1
 {
+	const int Idct::s_kernel4x4[] =
+	{
+		724,  946,  724,  392,
+		724,  392, -724, -946,
+		724, -392, -724,  946,
+		724, -946,  724, -392
+	};
+
+	const int Idct::s_kernel2x2[] =
+	{
+		724,  724,
+		724, -724
+	};
+
 	Idct::Idct()
 	{
 	}
@@ -15,6 +29,55 @@ namespace Mpeg1
 			idctColumn(dctCoefficients, column);
 	}
 
+	void Idct::calculate4x4(int *dctCoefficients)
+	{
+		reducedIdct(dctCoefficients, 4, s_kernel4x4);
+	}
+
+	void Idct::calculate2x2(int *dctCoefficients)
+	{
+		reducedIdct(dctCoefficients, 2, s_kernel2x2);
+	}
+
+	/// Separable inverse transform of a size x size block by direct products with the kernel, which
+	/// is cheap enough at these sizes. The 8 point coefficients are used as they are : the scale of
+	/// the 8 point transform and the size / 8 gain of the averaging cancel out.
+	void Idct::reducedIdct(int *dctCoefficients, int size, const int *kernel)
+	{
+		qint64 rows[16];
+
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				qint64 sum = 0;
+				for (int u = 0; u < size; u++)
+					sum += (qint64) kernel[x * size + u] * dctCoefficients[y * size + u];
+
+				rows[y * size + x] = sum;
+			}
+		}
+
+		const qint64 half = (qint64) 1 << (2 * FixedPointScale - 1);
+
+		for (int x = 0; x < size; x++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				qint64 sum = 0;
+				for (int v = 0; v < size; v++)
+					sum += kernel[y * size + v] * rows[v * size + x];
+
+				dctCoefficients[y * size + x] = (int)(sum < 0 ? -((half - sum) >> (2 * FixedPointScale)) : (sum + half) >> (2 * FixedPointScale));
+			}
+		}
+	}
+
+	int Idct::calculateDc(int dcCoefficient)
+	{
+		return dcCoefficient < 0 ? -((HalfDctSize - dcCoefficient) >> 3) : (dcCoefficient + HalfDctSize) >> 3;
+	}
+
 	void Idct::idctRow(int *dctCoefficients, int row)
 	{
 		const quint64 s1_0 = dctCoefficients[row * DctSize + 4] << 3;
@@ -39,11 +39,28 @@ namespace Mpeg1
 
 		static void calculate(int *dctCoefficients);
 
+		/// Reduces a block to 4x4 samples from its lowest 4x4 frequencies.
+		///
+		/// This is the 4 point inverse DCT scaled so that the samples are the averages of the 2x2
+		/// samples of the full block they stand for, which keeps the DC gain of calculate().
+		///
+		/// \param dctCoefficients the 4x4 coefficients in raster order, replaced by the samples
+		static void calculate4x4(int *dctCoefficients);
+
+		/// Same as calculate4x4 for 2x2 samples from the lowest 2x2 frequencies
+		static void calculate2x2(int *dctCoefficients);
+
+		/// Returns the value of every sample of a block whose only coefficient is the DC one,
+		/// rounded like calculate()
+		static int calculateDc(int dcCoefficient);
+
 	private:
 		static void idctRow(int *dctCoefficients, int row);
 
 		static void idctColumn(int *dctCoefficients, int column);
 
+		static void reducedIdct(int *dctCoefficients, int size, const int *kernel);
+
 	private:
 		// We perform these calculations manually so the
 		// code is CLDC 1.0 compliant.
@@ -59,6 +76,11 @@ namespace Mpeg1
 		static const qint64 c7 = 1702;	// c7 = (long)(factor * Math.cos(3.0 * alpha));
 		static const qint64 c8 = 1137;	// c8 = (long)(factor * Math.sin(3.0 * alpha));
 		static const qint64 c9 = 2896;	// c9 = (long)(factor * Math.sqrt(2.0));
+
+		// 0.5 * C(u) * cos((2x + 1) * u * PI / (2 * size)) for the reduced transforms, indexed by x
+		// then u, with C(0) = 1 / sqrt(2) and C(u) = 1 otherwise
+		static const int s_kernel4x4[];
+		static const int s_kernel2x2[];
 	};
 }
 
@@ -56,6 +56,27 @@ namespace Mpeg1
 		m_input->close();
 	}
 
+	QIODevice *InputBitstream::device() const
+	{
+		return m_input;
+	}
+
+	bool InputBitstream::seek(qint64 offset)
+	{
+		if(!m_input->seek(offset))
+			return false;
+
+		// The buffer is refilled entirely on the next read
+		m_bufferLength = BufferSize;
+		m_bufferIndex = BufferSize << 3;
+		return true;
+	}
+
+	qint64 InputBitstream::position() const
+	{
+		return m_input->pos() - m_bufferLength + (m_bufferIndex >> 3);
+	}
+
 	void InputBitstream::fillBuffer()
 	{
 		int byteOffset = m_bufferIndex >> 3;
@@ -163,4 +184,68 @@ namespace Mpeg1
 	{
 		return (m_bufferIndex & 0x7) == 0;
 	}
+
+	void InputBitstream::nextStartCode()
+	{
+		while (!isByteAligned())
+			getBits(1);
+
+		// Stays on a start code the stream is already sitting on
+		if (nextBits(24) != 0x000001)
+			skipToNextStartCode();
+	}
+
+	void InputBitstream::readToNextStartCode(QByteArray &data)
+	{
+		scanToNextStartCode(&data);
+	}
+
+	void InputBitstream::skipToNextStartCode()
+	{
+		scanToNextStartCode(0);
+	}
+
+	/// Moves to the next start code, appending the bytes passed to data unless it is 0
+	void InputBitstream::scanToNextStartCode(QByteArray *data)
+	{
+		// Take the start code the stream is sitting on, if any
+		if(nextBits(24) == 0x000001)
+		{
+			for(int i=0; i<4; i++)
+			{
+				char value = (char)getBits(8);
+				if(data)
+					data->append(value);
+			}
+		}
+
+		for(;;)
+		{
+			if(m_bufferIndex + 24 > m_bufferLength << 3)
+				fillBuffer();
+
+			int byteOffset = m_bufferIndex >> 3;
+			int end = m_bufferLength - 2;
+
+			// End of input, whatever is left is the tail of the stream
+			if(byteOffset >= end)
+			{
+				if(data)
+					data->append((const char *)(m_buffer + byteOffset), m_bufferLength - byteOffset);
+				m_bufferIndex = m_bufferLength << 3;
+				return;
+			}
+
+			int i = byteOffset;
+			while(i < end && !(m_buffer[i] == 0 && m_buffer[i + 1] == 0 && m_buffer[i + 2] == 1))
+				i++;
+
+			if(data)
+				data->append((const char *)(m_buffer + byteOffset), i - byteOffset);
+			m_bufferIndex = i << 3;
+
+			if(i < end)
+				return;
+		}
+	}
 }
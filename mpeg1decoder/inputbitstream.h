@@ -1,6 +1,7 @@
 #if !defined(MPEG1_INPUTBITSTREAM_H)
 #define MPEG1_INPUTBITSTREAM_H
 
+#include <QtCore/QByteArray>
 #include <QtCore/QIODevice>
 
 namespace Mpeg1
@@ -15,6 +16,18 @@ namespace Mpeg1
 
 		void close();
 
+		/// Returns the device the bitstream is read from
+		QIODevice *device() const;
+
+		/// Moves to a byte offset of the device, which must be random access, dropping whatever was
+		/// buffered. Decoding has to resume at a start code.
+		///
+		/// \return false if the device could not seek
+		bool seek(qint64 offset);
+
+		/// Returns the byte offset within the device of the next bit to be read, rounded down
+		qint64 position() const;
+
 		int nextBits(int count);
 
 		bool nextBool();
@@ -31,9 +44,30 @@ namespace Mpeg1
 
 		bool isByteAligned() const;
 
+		/// Remove any zero bit and zero byte stuffing and locates the next
+		/// start code. See ISO/IEC 11172-2 Section 2.3
+		void nextStartCode();
+
+		/// Appends the bytes from the current position up to (but not including) the next start
+		/// code prefix to the given array, consuming them. The stream must be byte aligned.
+		///
+		/// If the stream is positioned on a start code, the start code itself is copied as well.
+		/// This is used to hand a self contained piece of the bitstream to another thread.
+		///
+		/// \param data the array to append the bytes to.
+		void readToNextStartCode(QByteArray &data);
+
+		/// Moves past the start code the stream is positioned on, if any, and every byte up to the
+		/// next start code prefix, without looking at them. The stream must be byte aligned.
+		///
+		/// This is used to step over the slices of a picture which is not to be decoded.
+		void skipToNextStartCode();
+
 	private:
 		void fillBuffer();
 
+		void scanToNextStartCode(QByteArray *data);
+
 	private:
 		QIODevice *m_input;
 		quint8 *m_buffer;
@@ -0,0 +1,139 @@
+#include "macroblockbatch.h"
+#include "videopicture.h"
+
+namespace Mpeg1
+{
+	MacroblockBatch::MacroblockBatch(VideoPicture *picture, const VideoPicture *previous, const VideoPicture *future) :
+		m_picture(picture),
+		m_previous(previous),
+		m_future(future),
+		m_listener(0),
+		m_currentRow(0),
+		m_parsedRows(0)
+	{
+		m_picture->ref();
+		if(m_previous)
+			m_previous->ref();
+		if(m_future)
+			m_future->ref();
+
+		m_macroblockWidth = m_picture->luma().blocks().width();
+
+		m_rows.resize(m_picture->luma().blocks().height());
+		for(int i = 0; i < m_rows.count(); i++)
+			m_rows[i].macroblocks.reserve(m_macroblockWidth);
+	}
+
+	MacroblockBatch::~MacroblockBatch()
+	{
+		m_picture->release();
+		if(m_previous)
+			m_previous->release();
+		if(m_future)
+			m_future->release();
+	}
+
+	VideoPicture *MacroblockBatch::picture() const
+	{
+		return m_picture;
+	}
+
+	const VideoPicture *MacroblockBatch::previous() const
+	{
+		return m_previous;
+	}
+
+	const VideoPicture *MacroblockBatch::future() const
+	{
+		return m_future;
+	}
+
+	void MacroblockBatch::setListener(BatchListener *listener)
+	{
+		m_listener = listener;
+	}
+
+	Macroblock &MacroblockBatch::addMacroblock(quint32 address)
+	{
+		// A corrupt stream can address past the last row, keep those in the last row
+		int row = qMin((int)(address / m_macroblockWidth), m_rows.count() - 1);
+
+		int parsedRows = m_parsedRows.fetchAndAddRelaxed(0);
+		if(row > parsedRows)
+			completeRows(row);
+		else
+			row = parsedRows;
+
+		m_currentRow = &m_rows[row];
+		m_currentRow->macroblocks.resize(m_currentRow->macroblocks.count() + 1);
+
+		Macroblock &macroblock = m_currentRow->macroblocks.last();
+		macroblock.address = address;
+		macroblock.prediction = Macroblock::PredictionNone;
+		macroblock.codedBlockPattern = 0;
+		macroblock.quantizerScale = 0;
+		macroblock.forwardRight = macroblock.forwardDown = 0;
+		macroblock.backwardRight = macroblock.backwardDown = 0;
+		macroblock.firstCoefficient = m_currentRow->coefficients.count();
+		for(int i=0; i<6; i++)
+			macroblock.coefficientCount[i] = 0;
+
+		return macroblock;
+	}
+
+	void MacroblockBatch::addCoefficient(int block, int position, int value)
+	{
+		Coefficient coefficient;
+		coefficient.position = (quint8) position;
+		coefficient.value = (qint16) value;
+		m_currentRow->coefficients.append(coefficient);
+
+		m_currentRow->macroblocks.last().coefficientCount[block]++;
+	}
+
+	void MacroblockBatch::finish()
+	{
+		completeRows(m_rows.count());
+
+		if(m_listener)
+			m_listener->parsingFinished();
+	}
+
+	/// Publishes every row above the given one
+	void MacroblockBatch::completeRows(int rows)
+	{
+		int first = m_parsedRows.fetchAndAddRelaxed(0);
+		if(rows <= first)
+			return;
+
+		m_parsedRows.fetchAndStoreRelease(rows);
+
+		if(m_listener)
+			m_listener->rowsParsed(first, rows - first);
+	}
+
+	int MacroblockBatch::rowCount() const
+	{
+		return m_rows.count();
+	}
+
+	int MacroblockBatch::parsedRows() const
+	{
+		return m_parsedRows.fetchAndAddAcquire(0);
+	}
+
+	int MacroblockBatch::count(int row) const
+	{
+		return m_rows.at(row).macroblocks.count();
+	}
+
+	const Macroblock *MacroblockBatch::macroblocks(int row) const
+	{
+		return m_rows.at(row).macroblocks.constData();
+	}
+
+	const Coefficient *MacroblockBatch::coefficients(int row) const
+	{
+		return m_rows.at(row).coefficients.constData();
+	}
+}
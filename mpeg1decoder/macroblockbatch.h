@@ -0,0 +1,153 @@
+#if !defined(MPEG1_MACROBLOCKBATCH_H)
+#define MPEG1_MACROBLOCKBATCH_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QVector>
+
+namespace Mpeg1
+{
+	/// A non-zero dequantized DCT coefficient of a block
+	struct Coefficient
+	{
+		quint8 position;			//< Position within the 8x8 block in raster (not zig-zag) order
+		qint16 value;
+	};
+
+	/// The parsed syntax of a macroblock, which is everything needed to reconstruct it.
+	///
+	/// Skipped macroblocks are recorded as well, as they still need to be predicted.
+	struct Macroblock
+	{
+		enum Prediction
+		{
+			PredictionNone = 0,			//< Intra coded, the blocks replace the picture contents
+			PredictionForward,			//< Predicted from the previous anchor
+			PredictionBackward,			//< Predicted from the future anchor
+			PredictionBidirectional		//< Average of the forward and backward predictions
+		};
+
+		quint32 address;
+		quint8 prediction;
+		quint8 codedBlockPattern;
+		quint8 quantizerScale;
+
+		// Reconstructed luma motion vectors in half pel units. See MotionVector::vector().
+		qint16 forwardRight;
+		qint16 forwardDown;
+		qint16 backwardRight;
+		qint16 backwardDown;
+
+		// The coefficients of each coded block follow each other in MacroblockBatch::coefficients(),
+		// starting at this index within the row of the macroblock
+		int firstCoefficient;
+		quint8 coefficientCount[6];
+	};
+
+	/// Is told about the progress of the parser filling a MacroblockBatch.
+	///
+	/// The calls are made on the thread parsing the picture.
+	class BatchListener
+	{
+	public:
+		virtual ~BatchListener() {}
+
+		/// The given macroblock rows are complete and will not be changed any more
+		virtual void rowsParsed(int first, int count) = 0;
+
+		/// Every row has been parsed. This is the last call made to the listener.
+		virtual void parsingFinished() = 0;
+	};
+
+	/// The parsed macroblocks of one picture together with the pictures needed to reconstruct them.
+	///
+	/// This is what flows from the syntax parsing stage (PictureDecoder) to the reconstruction stage
+	/// (Reconstructor). The batch holds a reference to each of its pictures for as long as it exists.
+	///
+	/// Macroblocks are stored per macroblock row. Macroblocks arrive in address order, so as soon as
+	/// the parser moves past a row that row is complete and can be reconstructed on another thread
+	/// while the parser carries on with the rows below it.
+	class MacroblockBatch
+	{
+	public:
+		/// Constructs an empty batch
+		///
+		/// \param picture the picture to reconstruct into
+		/// \param previous the anchor used for forward prediction or 0
+		/// \param future the anchor used for backward prediction or 0
+		MacroblockBatch(class VideoPicture *picture, const class VideoPicture *previous, const class VideoPicture *future);
+
+		/// Destructor. Releases the pictures
+		~MacroblockBatch();
+
+		/// Returns the picture to reconstruct into
+		class VideoPicture *picture() const;
+
+		/// Returns the anchor used for forward prediction
+		const class VideoPicture *previous() const;
+
+		/// Returns the anchor used for backward prediction
+		const class VideoPicture *future() const;
+
+		/// Sets the listener told about rows as they are completed by the parser. Must be set before
+		/// the first macroblock is added.
+		void setListener(BatchListener *listener);
+
+		/// Appends a macroblock, returning it so that its coefficients can be added. Completes every
+		/// row above the one of the macroblock.
+		///
+		/// \param address the address of the macroblock. Must not be smaller than the previous one.
+		Macroblock &addMacroblock(quint32 address);
+
+		/// Appends a coefficient to the last block of the last macroblock added
+		///
+		/// \param block the index of the block within the macroblock (0-3 luma, 4 Cb, 5 Cr)
+		/// \param position the position within the block in raster order
+		/// \param value the dequantized coefficient
+		void addCoefficient(int block, int position, int value);
+
+		/// Completes every remaining row. Called by the parser once the picture has been parsed.
+		void finish();
+
+		/// Returns the number of macroblock rows in the picture
+		int rowCount() const;
+
+		/// Returns the number of rows from the top which are complete
+		int parsedRows() const;
+
+		/// Returns the number of macroblocks in a row
+		int count(int row) const;
+
+		/// Returns the macroblocks of a row in bitstream order
+		const Macroblock *macroblocks(int row) const;
+
+		/// Returns the coefficients of every macroblock of a row
+		const Coefficient *coefficients(int row) const;
+
+	private:
+		void completeRows(int rows);
+
+	private:
+		Q_DISABLE_COPY(MacroblockBatch)
+
+		struct Row
+		{
+			QVector<Macroblock> macroblocks;
+			QVector<Coefficient> coefficients;
+		};
+
+		class VideoPicture *m_picture;
+		const class VideoPicture *m_previous;
+		const class VideoPicture *m_future;
+
+		BatchListener *m_listener;
+
+		QVector<Row> m_rows;
+		Row *m_currentRow;
+		int m_macroblockWidth;
+
+		// Only written by the parser. Rows above it can be read from any thread.
+		mutable QAtomicInt m_parsedRows;
+	};
+}
+
+#endif
@@ -82,6 +82,11 @@ namespace Mpeg1
 		return m_chroma;
 	}
 
+	QPoint MotionVector::vector() const
+	{
+		return QPoint((m_luma.fullPel().x() << 1) | (m_luma.halfHorizontal() ? 1 : 0), (m_luma.fullPel().y() << 1) | (m_luma.halfVertical() ? 1 : 0));
+	}
+
 	// Reconstruct the motion vector horizontal and vertical components
 	void MotionVector::calculate(int motionHorizontalCode, int motionHorizontalR, int motionVerticalCode, int motionVerticalR)	
 	{
@@ -85,6 +85,9 @@ namespace Mpeg1
 
 		const MotionDescription &chroma() const;
 
+		/// Returns the reconstructed luma vector in half pel units, from which luma() and chroma() are derived
+		QPoint vector() const;
+
 	private:
 		// Reconstructed motion vector for the previous predictive-coded 
 		// macroblock.
@@ -1,29 +1,65 @@
 TEMPLATE = app
 
 HEADERS += \
+    batchdecoder.h \
+    colorconverter.h \
+    conversionstage.h \
     decoder.h \
+    displayorder.h \
+    executor.h \
+    grouplocator.h \
     idct.h \
     inputbitstream.h \
+    macroblockbatch.h \
     motionvector.h \
+    picturedecoder.h \
+    picturepool.h \
+    picturequeue.h \
     plane.h \
     planeblock.h \
+    rawvideowriter.h \
+    reconstructor.h \
+    ringbuffer.h \
+    rowscheduler.h \
+    startcodeindex.h \
+    startcodes.h \
+    streamprobe.h \
     utility.h \
+    videobuffer.h \
     videopicture.h \
     videorenderer.h \
     vlc.h \
+    test/framedecoder.h \
     test/qmpegdecoderview.h \
     test/mpegbitmap.h \
     test/mpegviewer.h
 
 SOURCES += \
+    batchdecoder.cpp \
+    colorconverter.cpp \
+    conversionstage.cpp \
     decoder.cpp \
+    displayorder.cpp \
+    executor.cpp \
+    grouplocator.cpp \
     idct.cpp \
     inputbitstream.cpp \
+    macroblockbatch.cpp \
     motionvector.cpp \
+    picturedecoder.cpp \
+    picturepool.cpp \
+    picturequeue.cpp \
     plane.cpp \
     planeblock.cpp \
+    rawvideowriter.cpp \
+    reconstructor.cpp \
+    rowscheduler.cpp \
+    startcodeindex.cpp \
+    streamprobe.cpp \
+    videobuffer.cpp \
     videopicture.cpp \
     vlc.cpp \
+    test/framedecoder.cpp \
     test/main.cpp \
     test/qmpegdecoderview.cpp \
     test/mpegbitmap.cpp \
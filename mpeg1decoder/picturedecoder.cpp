@@ -0,0 +1,574 @@
+#include "picturedecoder.h"
+#include "inputbitstream.h"
+#include "macroblockbatch.h"
+#include "startcodes.h"
+#include "videopicture.h"
+
+#include "utility.h"
+
+namespace Mpeg1
+{
+	// Position in raster order of each coefficient in zig-zag scan order
+	const quint8 PictureDecoder::s_zigzagToRaster[] = 
+	{
+		0,  1,  8, 16,  9,  2,  3, 10,
+		17, 24, 32, 25, 18, 11,  4,  5,
+		12, 19, 26, 33, 40, 48, 41, 34,
+		27, 20, 13,  6,  7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36,
+		29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46,
+		53, 60, 61, 54, 47, 55, 62, 63
+	};
+
+	PictureDecoder::PictureDecoder() :
+		m_input(0),
+		m_batch(0),
+		m_macroblock(0),
+		m_pictureCodingType(0),
+		m_macroblockWidth(0),
+		m_forwardF(1),
+		m_forwardRSize(0),
+		m_backwardF(1),
+		m_backwardRSize(0),
+		m_motionHorizontalForwardR(0),
+		m_motionVerticalForwardR(0),
+		m_motionHorizontalBackwardR(0),
+		m_motionVerticalBackwardR(0),
+		m_blockSize(8),
+		m_lastPosition(63),
+		m_lumaOnly(false),
+		m_levelCount(0)
+	{
+	}
+
+	void PictureDecoder::setMacroblockWidth(int macroblockWidth)
+	{
+		m_macroblockWidth = macroblockWidth;
+	}
+
+	void PictureDecoder::setQuantizerMatrices(const short *intraQuantizerMatrix, const short *nonIntraQuantizerMatrix)
+	{
+		copyShorts(intraQuantizerMatrix, 0, m_intraQuantizerMatrix, 0, 64);
+		copyShorts(nonIntraQuantizerMatrix, 0, m_nonIntraQuantizerMatrix, 0, 64);
+	}
+
+	void PictureDecoder::setBlockSize(int blockSize)
+	{
+		m_blockSize = blockSize;
+
+		// The last coefficient in zig-zag order within the low frequencies kept
+		m_lastPosition = 0;
+		for (int i = 0; i < 64; i++)
+		{
+			if (isKept(i))
+				m_lastPosition = i;
+		}
+	}
+
+	void PictureDecoder::setLumaOnly(bool lumaOnly)
+	{
+		m_lumaOnly = lumaOnly;
+	}
+
+	/// Returns true if the coefficient at a position in zig-zag order is within the low
+	/// frequencies kept for the block size
+	bool PictureDecoder::isKept(int position) const
+	{
+		int raster = s_zigzagToRaster[position];
+
+		return (raster & 7) < m_blockSize && (raster >> 3) < m_blockSize;
+	}
+
+	void PictureDecoder::setPictureType(int pictureCodingType)
+	{
+		m_pictureCodingType = pictureCodingType;
+	}
+
+	int PictureDecoder::pictureType() const
+	{
+		return m_pictureCodingType;
+	}
+
+	void PictureDecoder::setForwardVector(int forwardFCode, bool fullPelForwardVector)
+	{
+		m_forwardRSize = forwardFCode - 1;
+		m_forwardF = 1 << m_forwardRSize;
+
+		m_forward.initialize(m_forwardF, fullPelForwardVector);
+	}
+
+	void PictureDecoder::setBackwardVector(int backwardFCode, bool fullPelBackwardVector)
+	{
+		m_backwardRSize = backwardFCode - 1;
+		m_backwardF = 1 << m_backwardRSize;
+
+		m_backward.initialize(m_backwardF, fullPelBackwardVector);
+	}
+
+	void PictureDecoder::decodeSlices(InputBitstream *input, MacroblockBatch *batch)
+	{
+		beginSlices(input, batch);
+
+		while (decodeNextSlice())
+			;
+
+		finishSlices();
+	}
+
+	void PictureDecoder::beginSlices(InputBitstream *input, MacroblockBatch *batch)
+	{
+		m_input = input;
+		m_batch = batch;
+	}
+
+	bool PictureDecoder::decodeNextSlice()
+	{
+		if (!StartCodes::isSliceStartCode(m_input->nextBits(32)))
+			return false;
+
+		parseSlice();
+		return true;
+	}
+
+	void PictureDecoder::finishSlices()
+	{
+		m_batch->finish();
+
+		m_batch = 0;
+		m_macroblock = 0;
+	}
+
+	/// A slice is a series of an arbitrary number of macroblocks with 
+	/// the order of macroblocks starting from the upper-left of the 
+	/// picture and proceeding by raster-scan order from left to right 
+	/// and top to bottom. Every slice shall contain at least one 
+	/// macroblock. Slices shall not overlap and there shall be no gaps 
+	/// between slices.
+	void PictureDecoder::parseSlice()
+	{
+		int sliceStartCode = m_input->getBits(32);   // Ranging from 0x00000101 - 0x000001af
+		int sliceVerticalPosition = sliceStartCode & 0xff; // Range: 0x01 - 0xaf
+
+		m_dctDcYPast = m_dctDcCbPast = m_dctDcCrPast = 1024; // See ISO-11172-2 page 35
+		m_pastIntraAddress = -2; // See ISO-11172-2 page 36
+
+		// Reset at start of each slice
+		m_forward.resetPrevious();
+		m_backward.resetPrevious();
+
+		// Macroblocks have an address which is the number of the macroblock 
+		// in raster scan order. The top left macroblock in a picture has 
+		// address 0, the next one to the right has address 1 and so on. 
+		// If there are M macroblocks in a picture, then the bottom right 
+		// macroblock has an address M-1.
+		m_macroblockAddress = (sliceVerticalPosition - 1) * m_macroblockWidth - 1;
+
+		m_quantizerScale = m_input->getBits(5);
+
+		bool extraBitSlice = 0;
+		while (m_input->nextBool()) 
+		{
+			extraBitSlice = m_input->getBool();
+			m_input->getBits(8);	// extraInformationSlice
+		}
+		extraBitSlice = m_input->getBits(1);
+
+		do 
+		{
+			parseMacroblock();
+		} while (m_input->nextBits(23) != 0x0);
+
+		m_input->nextStartCode();
+	}
+
+	/// A macroblock has 4 luminance blocks and 2 chrominance blocks.
+	/// The order of blocks in a macroblock is top-left, top-right, 
+	/// bottom-left, bottom-right block for Y, followed by Cb and Cr.
+	/// A macroblock is the basic unit for motion compensation and 
+	/// quantizer scale changes.
+	void PictureDecoder::parseMacroblock()
+	{
+		// Discarded by decoder
+		while (m_input->nextBits(11) == 0xf) 
+		{
+			m_input->skipBits(11);	// macroblockStuffing
+		}
+
+		int macroblockAddressIncrement = 0;
+
+		while (m_input->nextBits(11) == 0x8) 
+		{
+			m_input->skipBits(11);	// macroblockEscape
+			macroblockAddressIncrement += 33;
+		}
+
+		macroblockAddressIncrement += Vlc::getMacroblockAddressIncrement(m_input);
+
+		// Process skipped macroblocks
+		if (macroblockAddressIncrement > 1) 
+		{
+			m_dctDcYPast = m_dctDcCrPast = m_dctDcCbPast = 1024;
+
+			// In P-pictures, the skipped macroblock is defined to be 
+			// a macroblock with a reconstructed motion vector equal 
+			// to zero and no DCT coefficients.
+			if (m_pictureCodingType == VideoPicture::PictureCodingP) 
+				m_forward.resetPrevious();
+
+			// In B-pictures, the skipped macroblock is defined to have 
+			// the same macroblock_type (forward, backward, or both motion 
+			// vectors) as the prior macroblock, differential motion 
+			// vectors equal to zero, and no DCT coefficients.
+			if (m_pictureCodingType == VideoPicture::PictureCodingP || m_pictureCodingType == VideoPicture::PictureCodingB) 
+			{
+				for (int i = 1; i < macroblockAddressIncrement; ++i) 
+				{
+					Macroblock &skipped = m_batch->addMacroblock(m_macroblockAddress + i);
+					skipped.quantizerScale = m_quantizerScale;
+					setPrediction(skipped, true);
+				}
+			}
+		}
+
+		m_macroblockAddress += macroblockAddressIncrement;
+
+		m_macroblockRow = m_macroblockAddress / m_macroblockWidth;
+		m_macroblockColumn = m_macroblockAddress % m_macroblockWidth;
+
+		// For macroblocks in I pictures, and for intra coded macroblocks in 
+		// P and B pictures, the coded block pattern is not transmitted, but 
+		// is assumed to have a value of 63, i.e. all the blocks in the 
+		// macroblock are coded.
+		int codedBlockPattern = 0x3f;
+
+		Vlc::getMacroblockType(m_pictureCodingType, m_input, m_macroblockType);
+
+		if (!m_macroblockType.macroblockIntra()) 
+		{
+			m_dctDcYPast = m_dctDcCrPast = m_dctDcCbPast = 1024;
+			codedBlockPattern = 0;
+		}
+
+		if (m_macroblockType.macroblockQuant())
+			m_quantizerScale = m_input->getBits(5);
+
+		if (m_macroblockType.macroblockMotionForward()) 
+		{
+			int motionHorizontalForwardCode = Vlc::getMotionVector(m_input);
+			if (m_forwardF != 1 && motionHorizontalForwardCode != 0) 
+			{
+				m_motionHorizontalForwardR = m_input->getBits(m_forwardRSize);
+			}
+
+			int motionVerticalForwardCode = Vlc::getMotionVector(m_input);
+			if (m_forwardF != 1 && motionVerticalForwardCode != 0) 
+			{
+				m_motionVerticalForwardR = m_input->getBits(m_forwardRSize);
+			}
+
+			m_forward.calculate(motionHorizontalForwardCode, m_motionHorizontalForwardR, motionVerticalForwardCode, m_motionVerticalForwardR);
+		}
+
+		if (m_macroblockType.macroblockMotionBackward()) 
+		{
+			int motionHorizontalBackwardCode = Vlc::getMotionVector(m_input);
+			if (m_backwardF != 1 && motionHorizontalBackwardCode != 0) 
+			{
+				m_motionHorizontalBackwardR = m_input->getBits(m_backwardRSize);
+			}
+
+			int motionVerticalBackwardCode = Vlc::getMotionVector(m_input);
+			if (m_backwardF != 1 && motionVerticalBackwardCode != 0) 
+			{
+				m_motionVerticalBackwardR = m_input->getBits(m_backwardRSize);
+			}
+
+			m_backward.calculate(motionHorizontalBackwardCode, m_motionHorizontalBackwardR, motionVerticalBackwardCode, m_motionVerticalBackwardR);
+		}
+
+		// In P pictures a macroblock without a forward vector is predicted with a zero vector
+		if (m_pictureCodingType == VideoPicture::PictureCodingP && !m_macroblockType.macroblockMotionForward())
+			m_forward.resetPrevious();
+
+		m_macroblock = &m_batch->addMacroblock(m_macroblockAddress);
+		m_macroblock->quantizerScale = m_quantizerScale;
+
+		if (!m_macroblockType.macroblockIntra())
+			setPrediction(*m_macroblock, false);
+
+		if (m_pictureCodingType == VideoPicture::PictureCodingB && m_macroblockType.macroblockIntra()) 
+		{
+			m_forward.resetPrevious();
+			m_backward.resetPrevious();
+		}
+
+		if (m_macroblockType.macroblockPattern())
+			codedBlockPattern = Vlc::getCodedBlockPattern(m_input);
+
+		// Chroma blocks are not reconstructed when only decoding luma
+		m_macroblock->codedBlockPattern = m_lumaOnly ? (codedBlockPattern & 0x3c) : codedBlockPattern;
+
+		// The Coded Block Pattern informs the decoder which of the six blocks 
+		// in the macroblock are coded, i.e. have transmitted DCT quantized 
+		// coefficients, and which are not coded, i.e. have no additional 
+		// correction after motion compensation
+		for (int i = 0; i < 6; i++)	
+		{
+			if ((codedBlockPattern & (1 << (5 - i))) == 0) 
+				continue;
+
+			if (i >= 4 && m_lumaOnly)
+				skipBlock(i);
+			else
+				parseBlock(i);
+		}
+
+		if (m_pictureCodingType == VideoPicture::PictureCodingD)
+			m_input->getBits(1);
+	}
+
+	/// Fills in the prediction of a non-intra macroblock from the current macroblock type and
+	/// motion vectors. See ISO/IEC 11172 2.4.4.2 / 2.4.4.3
+	///
+	/// \param macroblock the macroblock to fill in
+	/// \param skipped true for a skipped macroblock, which in B pictures repeats the prior macroblock
+	void PictureDecoder::setPrediction(Macroblock &macroblock, bool skipped) const
+	{
+		QPoint forwardVector = m_forward.vector();
+		QPoint backwardVector = m_backward.vector();
+
+		if (m_pictureCodingType == VideoPicture::PictureCodingP)
+		{
+			// Skipped macroblocks and macroblocks without a forward vector are a copy of the previous anchor
+			macroblock.prediction = Macroblock::PredictionForward;
+
+			if (skipped || !m_macroblockType.macroblockMotionForward())
+				forwardVector = QPoint();
+		}
+		else if (m_macroblockType.macroblockMotionForward() && m_macroblockType.macroblockMotionBackward())
+			macroblock.prediction = Macroblock::PredictionBidirectional;
+		else if (m_macroblockType.macroblockMotionForward())
+			macroblock.prediction = Macroblock::PredictionForward;
+		else if (m_macroblockType.macroblockMotionBackward())
+			macroblock.prediction = Macroblock::PredictionBackward;
+
+		macroblock.forwardRight = (qint16) forwardVector.x();
+		macroblock.forwardDown = (qint16) forwardVector.y();
+		macroblock.backwardRight = (qint16) backwardVector.x();
+		macroblock.backwardDown = (qint16) backwardVector.y();
+	}
+
+	/// A block is an orthogonal 8-pel by 8-line section of a 
+	/// luminance or chrominance component.
+	///
+	/// The coefficients are dequantized as they are parsed and only the non-zero ones are
+	/// added to the batch.
+	void PictureDecoder::parseBlock(int index)
+	{
+		Vlc::RunLevel runLevel;
+
+		m_levelCount = 0;
+
+		int run = 0;
+		int dctDCDifferential = 0;
+
+		if (m_macroblockType.macroblockIntra()) 
+		{
+			if (index < 4) 
+			{
+				int dctDCSizeLuminance = Vlc::decodeDCTDCSizeLuminance(m_input);
+
+				if (dctDCSizeLuminance != 0) 
+				{
+					dctDCDifferential = m_input->getBits(dctDCSizeLuminance);
+
+					if ((dctDCDifferential & (1 << (dctDCSizeLuminance - 1))) == 0)
+						dctDCDifferential = ((-1 << dctDCSizeLuminance) | (dctDCDifferential + 1));
+				}
+			}
+			else 
+			{
+				int dctDCSizeChrominance = Vlc::decodeDCTDCSizeChrominance(m_input);
+
+				if (dctDCSizeChrominance != 0) 
+				{
+					dctDCDifferential = m_input->getBits(dctDCSizeChrominance);
+
+					if ((dctDCDifferential & (1 << (dctDCSizeChrominance - 1))) == 0)
+						dctDCDifferential = ((-1 << dctDCSizeChrominance) | (dctDCDifferential + 1));
+				}
+			}
+		}
+		else 
+		{
+			// dctCoeffFirst
+			Vlc::decodeDCTCoeff(m_input, true, runLevel);
+
+			run = runLevel.run();
+			addLevel(run, runLevel.level());
+		}
+
+		if (m_pictureCodingType != VideoPicture::PictureCodingD) 
+		{
+			while (m_input->nextBits(2) != 0x2) 
+			{
+				// Past the low frequencies kept, the rest of the block is stepped over
+				if (run >= m_lastPosition)
+				{
+					Vlc::skipDCTCoeff(m_input, false);
+					continue;
+				}
+
+				// dctCoeffNext
+				Vlc::decodeDCTCoeff(m_input, false, runLevel);
+
+				run += runLevel.run() + 1;
+				addLevel(run, runLevel.level());
+			}
+
+			m_input->skipBits(2); // endOfBlock, Should be == 0x2 (EOB)
+		}
+
+		if (m_macroblockType.macroblockIntra()) 
+		{
+			intraBlock(index, dctDCDifferential);
+			m_pastIntraAddress = m_macroblockAddress;
+		}
+		else
+		{
+			nonIntraBlock(index);
+		}
+	}
+
+	/// Steps over a block without keeping any of its coefficients. The DC predictors are left
+	/// alone, so this is only good for components which are never reconstructed.
+	void PictureDecoder::skipBlock(int index)
+	{
+		if (m_macroblockType.macroblockIntra()) 
+		{
+			int dctDCSize = (index < 4) ? Vlc::decodeDCTDCSizeLuminance(m_input) : Vlc::decodeDCTDCSizeChrominance(m_input);
+
+			if (dctDCSize != 0)
+				m_input->skipBits(dctDCSize);	// dctDCDifferential
+		}
+		else
+			Vlc::skipDCTCoeff(m_input, true);	// dctCoeffFirst
+
+		if (m_pictureCodingType == VideoPicture::PictureCodingD)
+			return;
+
+		while (m_input->nextBits(2) != 0x2) 
+			Vlc::skipDCTCoeff(m_input, false);	// dctCoeffNext
+
+		m_input->skipBits(2); // endOfBlock
+	}
+
+	/// Remembers a quantized coefficient of the block being parsed
+	void PictureDecoder::addLevel(int position, int level)
+	{
+		// Corrupt streams can run past the end of the block
+		if (position > 63 || level == 0)
+			return;
+
+		if (m_blockSize < 8 && !isKept(position))
+			return;
+
+		m_levelPosition[m_levelCount] = (quint8) position;
+		m_level[m_levelCount] = level;
+		m_levelCount++;
+	}
+
+	/// Helper function
+	int PictureDecoder::sign(int n) 
+	{
+		return n > 0 ? 1 : (n < 0 ? -1 : 0);
+	}
+
+	/// Saturates a reconstructed coefficient, see ISO/IEC 11172 2.4.4.1
+	int PictureDecoder::saturate(int dctRecon)
+	{
+		if (dctRecon > 2047) 
+			return 2047;
+
+		if (dctRecon < -2048) 
+			return -2048;
+
+		return dctRecon;
+	}
+
+	/// Reconstruct DCT coefficients, as defined in ISO/IEC 11172 2.4.4.1
+	///
+	/// The DC coefficient is predicted from the previous block of the same component.
+	void PictureDecoder::intraBlock(int index, int dctDCDifferential)
+	{
+		int dctRecon = dctDCDifferential << 3;
+
+		switch (index)
+		{
+		case 0:
+			if (m_macroblockAddress - m_pastIntraAddress > 1)
+				dctRecon += 1024;
+			else
+				dctRecon += m_dctDcYPast;
+			m_dctDcYPast = dctRecon;
+			break;
+
+		case 1:
+		case 2:
+		case 3:
+			dctRecon += m_dctDcYPast;
+			m_dctDcYPast = dctRecon;
+			break;
+
+		case 4:
+			if (m_macroblockAddress - m_pastIntraAddress > 1)
+				dctRecon += 1024;
+			else
+				dctRecon += m_dctDcCbPast;
+			m_dctDcCbPast = dctRecon;
+			break;
+
+		default:
+			if (m_macroblockAddress - m_pastIntraAddress > 1)
+				dctRecon += 1024;
+			else
+				dctRecon += m_dctDcCrPast;
+			m_dctDcCrPast = dctRecon;
+			break;
+		}
+
+		m_batch->addCoefficient(index, 0, dctRecon);
+
+		for (int i = 0; i < m_levelCount; ++i) 
+		{
+			int position = s_zigzagToRaster[m_levelPosition[i]];
+			if (position == 0)
+				continue;
+
+			dctRecon = (m_level[i] * m_quantizerScale * m_intraQuantizerMatrix[position]) >> 3;
+
+			if ((dctRecon & 1) == 0) 
+				dctRecon -= sign(dctRecon);
+
+			m_batch->addCoefficient(index, position, saturate(dctRecon));
+		}
+	}
+
+	/// Reconstruct DCT coefficients, as defined in ISO/IEC 11172 2.4.4.2 / 2.4.4.3
+	void PictureDecoder::nonIntraBlock(int index)
+	{
+		for (int i = 0; i < m_levelCount; ++i) 
+		{
+			int position = s_zigzagToRaster[m_levelPosition[i]];
+			int level = m_level[i];
+
+			int dctRecon = ((2 * level + sign(level)) * m_quantizerScale * m_nonIntraQuantizerMatrix[position]) >> 4;
+
+			if ((dctRecon & 1) == 0) 
+				dctRecon -= sign(dctRecon);
+
+			m_batch->addCoefficient(index, position, saturate(dctRecon));
+		}
+	}
+}
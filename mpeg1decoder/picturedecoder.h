@@ -0,0 +1,169 @@
+#if !defined(MPEG1_PICTUREDECODER_H)
+#define MPEG1_PICTUREDECODER_H
+
+#include <QtCore/Qt>
+
+#include "motionvector.h"
+#include "vlc.h"
+
+namespace Mpeg1
+{
+	/// Parses the slice, macroblock and block layers of a single picture.
+	///
+	/// Decoder parses the sequence, group of pictures and picture layers and hands the slices of each
+	/// picture to an instance of this class. All state needed below the picture layer lives here, and
+	/// the class is copyable, so that a copy configured for one picture can parse that picture on a
+	/// worker thread from its own InputBitstream while the Decoder carries on with the next picture.
+	///
+	/// This is only the syntax stage of decoding: the variable length codes are decoded, the motion
+	/// vectors reconstructed and the coefficients dequantized into a MacroblockBatch. No pixel is
+	/// touched, that is left to the Reconstructor.
+	class PictureDecoder
+	{
+	public:
+		PictureDecoder();
+
+		/// Sets the width of the picture in macroblocks as given by the sequence header
+		void setMacroblockWidth(int macroblockWidth);
+
+		/// Sets the quantizer matrices as given by the sequence header. Both are copied.
+		///
+		/// \param intraQuantizerMatrix 64 values to use for intra coded blocks
+		/// \param nonIntraQuantizerMatrix 64 values to use for non-intra coded blocks
+		void setQuantizerMatrices(const short *intraQuantizerMatrix, const short *nonIntraQuantizerMatrix);
+
+		/// Keeps only the coefficients of the lowest blockSize x blockSize frequencies of each block,
+		/// for decoding at reduced size. The others are stepped over without being dequantized, and
+		/// at a block size of 1 only the DC coefficient is kept.
+		///
+		/// \param blockSize the width and height of a block as decoded : 8, 4, 2 or 1. The default is 8.
+		void setBlockSize(int blockSize);
+
+		/// Steps over the chroma blocks, which are then left out of the batch, for decoding only
+		/// the luma plane.
+		void setLumaOnly(bool lumaOnly);
+
+		/// Sets the picture coding type from the picture header (see VideoPicture::PictureCoding)
+		void setPictureType(int pictureCodingType);
+
+		/// Returns the picture coding type currently being decoded
+		int pictureType() const;
+
+		/// Sets the forward motion vector parameters from the picture header of P and B pictures
+		///
+		/// \param forwardFCode the forward_f_code value from the picture header. Can't be 0.
+		/// \param fullPelForwardVector true if the forward vectors are in full pel units
+		void setForwardVector(int forwardFCode, bool fullPelForwardVector);
+
+		/// Sets the backward motion vector parameters from the picture header of B pictures
+		///
+		/// \param backwardFCode the backward_f_code value from the picture header. Can't be 0.
+		/// \param fullPelBackwardVector true if the backward vectors are in full pel units
+		void setBackwardVector(int backwardFCode, bool fullPelBackwardVector);
+
+		/// Parses every slice from the current position of the input up to the next start code which
+		/// is not a slice start code.
+		///
+		/// \param input the bitstream positioned on the first slice start code of the picture
+		/// \param batch receives the macroblocks of the picture. Finished once every slice is parsed.
+		void decodeSlices(class InputBitstream *input, class MacroblockBatch *batch);
+
+		/// Starts parsing a picture one slice at a time, for a caller bounding the work done at once.
+		/// decodeSlices() is beginSlices(), decodeNextSlice() until it returns false, and finishSlices().
+		///
+		/// \param input the bitstream positioned on the first slice start code of the picture
+		/// \param batch receives the macroblocks of the picture
+		void beginSlices(class InputBitstream *input, class MacroblockBatch *batch);
+
+		/// Parses the slice the input is positioned on
+		///
+		/// \return false, without parsing anything, if the input is not on a slice start code
+		bool decodeNextSlice();
+
+		/// Finishes the batch of the picture, completing the rows no slice reached
+		void finishSlices();
+
+	private:
+		void parseSlice();
+
+		void parseMacroblock();
+
+		void setPrediction(struct Macroblock &macroblock, bool skipped) const;
+
+		void parseBlock(int index);
+
+		void skipBlock(int index);
+
+		void addLevel(int position, int level);
+
+		bool isKept(int position) const;
+
+		static int sign(int n);
+
+		static int saturate(int dctRecon);
+
+		void intraBlock(int index, int dctDCDifferential);
+
+		void nonIntraBlock(int index);
+
+	private:
+		class InputBitstream *m_input;
+
+		class MacroblockBatch *m_batch;
+		struct Macroblock *m_macroblock;
+
+		MotionVector m_forward;
+		MotionVector m_backward;
+
+		int m_pictureCodingType;		// TODO : Convert to enum
+
+		int m_macroblockWidth;
+
+		int m_macroblockRow;
+		int m_macroblockColumn;
+
+		short m_intraQuantizerMatrix[64];
+		short m_nonIntraQuantizerMatrix[64];
+
+		static const quint8 s_zigzagToRaster[];
+
+		// Only present in P and B pictures
+		int m_forwardF;
+		int m_forwardRSize;
+
+		// Only present in B pictures
+		int m_backwardF;
+		int m_backwardRSize;
+
+		// Predictors
+		int m_dctDcYPast;
+		int m_dctDcCbPast;
+		int m_dctDcCrPast;
+
+		int m_pastIntraAddress;
+		int m_macroblockAddress;
+		int m_quantizerScale;
+
+		// Used for decoding motion vectors
+		int m_motionHorizontalForwardR;
+		int m_motionVerticalForwardR;
+
+		int m_motionHorizontalBackwardR;
+		int m_motionVerticalBackwardR;
+
+		Vlc::MacroblockType m_macroblockType;
+
+		// Coefficients kept, and the position in zig-zag order of the last of them
+		int m_blockSize;
+		int m_lastPosition;
+
+		bool m_lumaOnly;
+
+		// Quantized coefficients of the block being parsed, positions in zig-zag order
+		int m_levelCount;
+		quint8 m_levelPosition[64];
+		int m_level[64];
+	};
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "picturepool.h"
+#include "videopicture.h"
+
+#include <QtCore/QMutexLocker>
+
+namespace Mpeg1
+{
+	PicturePool::PicturePool() :
+		m_allocatedCount(0),
+		m_lumaOnly(false)
+	{
+	}
+
+	PicturePool::~PicturePool()
+	{
+		while(!m_free.isEmpty())
+			delete m_free.takeFirst();
+	}
+
+	void PicturePool::setFormat(const QSize &blocks, const QSize &lumaBlockSize, const QSize &chromaBlockSize, bool lumaOnly)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		if(blocks == m_blocks && lumaBlockSize == m_lumaBlockSize && chromaBlockSize == m_chromaBlockSize && lumaOnly == m_lumaOnly)
+			return;
+
+		m_blocks = blocks;
+		m_lumaBlockSize = lumaBlockSize;
+		m_chromaBlockSize = chromaBlockSize;
+		m_lumaOnly = lumaOnly;
+
+		while(!m_free.isEmpty())
+		{
+			delete m_free.takeFirst();
+			m_allocatedCount--;
+		}
+	}
+
+	VideoPicture *PicturePool::acquire()
+	{
+		QMutexLocker locker(&m_mutex);
+
+		if(!m_free.isEmpty())
+		{
+			VideoPicture *picture = m_free.takeLast();
+			picture->m_references = 1;
+			picture->m_decodedRows = 0;
+			return picture;
+		}
+
+		VideoPicture *picture = new VideoPicture;
+		if(!picture->allocate(m_blocks, m_lumaBlockSize, m_chromaBlockSize, m_lumaOnly))
+		{
+			delete picture;
+			return 0;
+		}
+
+		picture->m_pool = this;
+		m_allocatedCount++;
+
+		return picture;
+	}
+
+	bool PicturePool::reserve(int count)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		while(m_allocatedCount < count)
+		{
+			VideoPicture *picture = new VideoPicture;
+			if(!picture->allocate(m_blocks, m_lumaBlockSize, m_chromaBlockSize, m_lumaOnly))
+			{
+				delete picture;
+				return false;
+			}
+
+			picture->m_pool = this;
+			m_allocatedCount++;
+
+			m_free.append(picture);
+		}
+
+		return true;
+	}
+
+	int PicturePool::allocatedCount() const
+	{
+		QMutexLocker locker(&m_mutex);
+
+		return m_allocatedCount;
+	}
+
+	void PicturePool::recycle(VideoPicture *picture)
+	{
+		QMutexLocker locker(&m_mutex);
+
+		if(!hasFormat(picture))
+		{
+			delete picture;
+			m_allocatedCount--;
+			return;
+		}
+
+		m_free.append(picture);
+	}
+
+	bool PicturePool::hasFormat(const VideoPicture *picture) const
+	{
+		return picture->luma().blocks() == m_blocks &&
+			picture->luma().blockSize() == m_lumaBlockSize &&
+			picture->chromaBlue().blockSize() == m_chromaBlockSize &&
+			picture->isLumaOnly() == m_lumaOnly;
+	}
+}
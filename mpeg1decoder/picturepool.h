@@ -0,0 +1,73 @@
+#if !defined(MPEG1_PICTUREPOOL_H)
+#define MPEG1_PICTUREPOOL_H
+
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSize>
+
+namespace Mpeg1
+{
+	/// Recycles video pictures of a single geometry between the decoder and its consumers.
+	///
+	/// Pictures are reference counted (see VideoPicture::ref() and VideoPicture::release()) so that
+	/// an anchor picture can be shared by the decoding thread and any number of worker threads
+	/// reconstructing B pictures from it. When the last reference is dropped the picture comes back
+	/// to the pool instead of being freed. The pool is safe to use from multiple threads.
+	class PicturePool
+	{
+	public:
+		/// Base constructor. Does not allocate memory
+		PicturePool();
+
+		/// Destructor. All pictures must have been released before the pool is destroyed.
+		~PicturePool();
+
+		/// Sets the geometry of the pictures handed out by acquire().
+		///
+		/// If the geometry differs from the current one, unused pictures are freed and pictures still
+		/// in use are freed as they are released.
+		///
+		/// \param blocks the number of macroblocks across and down for the picture.
+		/// \param lumaBlockSize the number of samples in a luma channel block. Generally 16.
+		/// \param chromaBlockSize the number of samples in a chroma channel block. Generally 8.
+		/// \param lumaOnly true for pictures without chroma planes. See VideoPicture::allocate().
+		void setFormat(const QSize &blocks, const QSize &lumaBlockSize, const QSize &chromaBlockSize, bool lumaOnly = false);
+
+		/// Returns an unused picture with a single reference held by the caller.
+		///
+		/// The picture contents are whatever was left by its previous user, but no rows are marked as
+		/// decoded. A new picture is allocated if none are free.
+		///
+		/// \return the picture or 0 if memory could not be allocated.
+		class VideoPicture *acquire();
+
+		/// Allocates pictures of the current geometry until the pool owns at least the given number,
+		/// so that acquire() doesn't have to allocate while decoding.
+		///
+		/// \return false if memory could not be allocated
+		bool reserve(int count);
+
+		/// Returns the number of pictures currently owned by the pool, whether in use or not.
+		int allocatedCount() const;
+
+	private:
+		friend class VideoPicture;
+
+		/// Called by VideoPicture::release() when the last reference is dropped
+		void recycle(class VideoPicture *picture);
+
+		bool hasFormat(const class VideoPicture *picture) const;
+
+	private:
+		mutable QMutex m_mutex;
+		QList<class VideoPicture *> m_free;
+		int m_allocatedCount;
+
+		QSize m_blocks;
+		QSize m_lumaBlockSize;
+		QSize m_chromaBlockSize;
+		bool m_lumaOnly;
+	};
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include "picturequeue.h"
+#include "videopicture.h"
+
+#include <QtCore/QThread>
+
+namespace Mpeg1
+{
+	PictureQueue::PictureQueue(int capacity, WaitMode waitMode) :
+		m_pictures(capacity),
+		m_waitMode(waitMode),
+		m_cancelled(0),
+		m_reopened(0),
+		m_endsTaken(0)
+	{
+	}
+
+	PictureQueue::~PictureQueue()
+	{
+		const VideoPicture *picture;
+		while(m_pictures.tryPop(picture))
+		{
+			if(picture)
+				picture->release();
+		}
+	}
+
+	void PictureQueue::setWaitMode(WaitMode waitMode)
+	{
+		m_waitMode.fetchAndStoreRelaxed(waitMode);
+	}
+
+	PictureQueue::WaitMode PictureQueue::waitMode() const
+	{
+		return (WaitMode) m_waitMode.fetchAndAddRelaxed(0);
+	}
+
+	int PictureQueue::capacity() const
+	{
+		return m_pictures.capacity();
+	}
+
+	int PictureQueue::count() const
+	{
+		return m_pictures.count();
+	}
+
+	bool PictureQueue::push(const VideoPicture *picture)
+	{
+		if(isCancelled())
+			return false;
+
+		picture->ref();
+
+		if(waitMode() == WaitBlock)
+		{
+			m_pictures.push(picture);
+			return true;
+		}
+
+		while(!m_pictures.tryPush(picture))
+		{
+			// Nobody is taking pictures any more
+			if(isCancelled())
+			{
+				picture->release();
+				return false;
+			}
+
+			QThread::yieldCurrentThread();
+		}
+
+		return true;
+	}
+
+	void PictureQueue::close()
+	{
+		if(isCancelled())
+			return;
+
+		// As in push(), cancel() empties the ring and so wakes a blocking push
+		if(waitMode() == WaitBlock)
+		{
+			m_pictures.push(0);
+			return;
+		}
+
+		while(!m_pictures.tryPush(0) && !isCancelled())
+			QThread::yieldCurrentThread();
+	}
+
+	void PictureQueue::reopen()
+	{
+		if(isCancelled())
+		{
+			// The consumer has stopped taking pictures, so this drops what a push or close racing
+			// with its cancel() left behind, the end marker included
+			const VideoPicture *picture;
+			while(m_pictures.tryPop(picture))
+			{
+				if(picture)
+					picture->release();
+			}
+
+			m_cancelled.fetchAndStoreOrdered(0);
+		}
+
+		m_reopened.fetchAndAddOrdered(1);
+	}
+
+	const VideoPicture *PictureQueue::pop()
+	{
+		if(isClosed())
+			return 0;
+
+		const VideoPicture *picture;
+		if(waitMode() == WaitBlock)
+		{
+			picture = m_pictures.pop();
+		}
+		else
+		{
+			while(!m_pictures.tryPop(picture))
+				QThread::yieldCurrentThread();
+		}
+
+		if(!picture)
+			m_endsTaken++;
+
+		return picture;
+	}
+
+	bool PictureQueue::tryPop(const VideoPicture *&picture)
+	{
+		picture = 0;
+		if(isClosed())
+			return true;
+
+		if(!m_pictures.tryPop(picture))
+			return false;
+
+		if(!picture)
+			m_endsTaken++;
+
+		return true;
+	}
+
+	void PictureQueue::cancel()
+	{
+		m_cancelled.fetchAndStoreOrdered(1);
+		m_endsTaken = m_reopened.fetchAndAddAcquire(0) + 1;
+
+		// Emptying the queue also wakes a producer waiting for room
+		const VideoPicture *picture;
+		while(m_pictures.tryPop(picture))
+		{
+			if(picture)
+				picture->release();
+		}
+	}
+
+	bool PictureQueue::isCancelled() const
+	{
+		return m_cancelled.fetchAndAddAcquire(0) != 0;
+	}
+
+	bool PictureQueue::isClosed() const
+	{
+		return m_endsTaken > m_reopened.fetchAndAddAcquire(0);
+	}
+}
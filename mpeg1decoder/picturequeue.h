@@ -0,0 +1,101 @@
+#if !defined(MPEG1_PICTUREQUEUE_H)
+#define MPEG1_PICTUREQUEUE_H
+
+#include <QtCore/QAtomicInt>
+
+#include "ringbuffer.h"
+
+namespace Mpeg1
+{
+	/// A bounded queue of decoded pictures between the decoder and a consumer on another thread.
+	///
+	/// The decoding thread pushes each picture in display order as it is completed, and the
+	/// consumer (a display or an encoder) takes them on its own thread. The queue holds a reference
+	/// to every picture in it and the reference is handed over to the consumer by pop(). As pictures
+	/// come from the decoder's pool, the consumer must release them before the decoder is destroyed.
+	///
+	/// The queue is a lock free single producer, single consumer ring. Its capacity bounds the
+	/// memory used by pictures decoded ahead of the consumer : the decoder waits when the queue is
+	/// full, and the consumer waits when it is empty. Waiting either sleeps, which suits a consumer
+	/// paced by a display, or spins, which gives the lowest latency when both sides are busy.
+	class PictureQueue
+	{
+	public:
+		enum WaitMode
+		{
+			WaitBlock,			//< Sleep until the other side makes progress
+			WaitSpin			//< Yield the processor and try again
+		};
+
+		/// Constructs the queue
+		///
+		/// \param capacity the maximum number of pictures queued. Rounded up to a power of two.
+		/// \param waitMode how the producer and consumer wait on a full or empty queue
+		PictureQueue(int capacity = 4, WaitMode waitMode = WaitBlock);
+
+		/// Destructor. Releases any picture still queued
+		~PictureQueue();
+
+		void setWaitMode(WaitMode waitMode);
+
+		WaitMode waitMode() const;
+
+		/// Returns the maximum number of pictures queued
+		int capacity() const;
+
+		/// Returns the number of pictures queued
+		int count() const;
+
+		/// Queues a picture, waiting while the queue is full. Producer only.
+		///
+		/// \param picture the picture, to which the queue takes a reference of its own
+		/// \return false if the consumer has cancelled the queue, in which case nothing was queued
+		bool push(const class VideoPicture *picture);
+
+		/// Marks the end of the pictures. Producer only. Gives up if the consumer has cancelled.
+		void close();
+
+		/// Starts a new run of pictures after close() or cancel(), for decoding again after a seek.
+		/// Producer only, and after the consumer's cancel() has returned. A consumer which hasn't
+		/// cancelled takes the end of the previous run first, then the pictures of the new one.
+		void reopen();
+
+		/// Takes the next picture, waiting while the queue is empty. Consumer only.
+		///
+		/// \return the picture with a reference held by the caller, or 0 once the queue is closed and
+		/// every picture has been taken, until it is reopened
+		const class VideoPicture *pop();
+
+		/// Takes the next picture if there is one. Consumer only.
+		///
+		/// \param picture receives the picture with a reference held by the caller, or 0 at the end
+		/// \return false if the queue is empty but not yet closed
+		bool tryPop(const class VideoPicture *&picture);
+
+		/// Tells the producer that no more pictures will be taken and releases the queued ones.
+		/// Consumer only. The queue stays closed to the consumer until it is reopened.
+		void cancel();
+
+		/// Returns true if the consumer has cancelled the queue
+		bool isCancelled() const;
+
+	private:
+		Q_DISABLE_COPY(PictureQueue)
+
+		// A null picture marks the end of the stream
+		RingBuffer<const class VideoPicture *> m_pictures;
+
+		mutable QAtomicInt m_waitMode;
+		mutable QAtomicInt m_cancelled;
+
+		// Every run but the first starts with reopen(). The current run is over to the consumer
+		// once it has taken more end markers than there have been reopens, and cancel() ends it
+		// without waiting for its marker.
+		mutable QAtomicInt m_reopened;
+		int m_endsTaken;		//< Consumer side
+
+		bool isClosed() const;
+	};
+}
+
+#endif
@@ -2,11 +2,14 @@
 #include "planeblock.h"
 #include "motionvector.h"
 
+#include <string.h>
+
 namespace Mpeg1
 {
 	/// Constructor
 	Plane::Plane() :
-		m_data(0)
+		m_data(0),
+		m_stride(0)
 	{
 	}
 
@@ -22,7 +25,7 @@ namespace Mpeg1
 	/// \param blockSize the size of the block in samples
 	bool Plane::allocate(const QSize &blocks, const QSize &blockSize)
 	{
-		delete m_data;
+		delete [] m_data;
 
 		m_size = QSize(blocks.width() * blockSize.width(), blocks.height() * blockSize.height());
 		m_blocks = blocks;
@@ -32,12 +35,43 @@ namespace Mpeg1
 
 		m_data = new qreal[m_stride * m_size.height()];
 
-		for(quint32 i=0; i<m_stride * m_size.height(); i++)
-			m_data[i] = 0.0f;
+		// Zero is all bits clear. Writing every page now also keeps the page faults out of decoding.
+		memset(m_data, 0, m_stride * m_size.height() * sizeof(qreal));
+
+		return m_data != 0;
+	}
+
+	/// Allocates a plane in which every sample has the same value, for a component which is not
+	/// decoded. Only a single line is stored and every scan line is that line, so the plane reads
+	/// like any other but must not be written to.
+	///
+	/// \param blocks the number of blocks across and down
+	/// \param blockSize the size of the block in samples
+	/// \param value the value of every sample
+	bool Plane::allocateConstant(const QSize &blocks, const QSize &blockSize, qreal value)
+	{
+		delete [] m_data;
+
+		m_size = QSize(blocks.width() * blockSize.width(), blocks.height() * blockSize.height());
+		m_blocks = blocks;
+		m_blockSize = blockSize;
+
+		m_stride = 0;
+
+		m_data = new qreal[m_size.width()];
+
+		for(int i=0; i<m_size.width(); i++)
+			m_data[i] = value;
 
 		return m_data != 0;
 	}
 
+	/// Returns true if the plane was allocated with allocateConstant()
+	bool Plane::isConstant() const
+	{
+		return m_data && m_stride == 0;
+	}
+
 	/// Returns a pointer to the start of the specified scan line
 	qreal *Plane::scanLine(quint32 line)
 	{
@@ -162,13 +196,13 @@ namespace Mpeg1
 		ConstPlaneBlock sourceBlock(source, position + motion.fullPel());
 		PlaneBlock destination(*this, linearAddressToPosition(destinationBlockAddress));
 
-		if(motion.halfHorizontal() && motion.halfHorizontal())
+		if(motion.halfHorizontal() && motion.halfVertical())
 		{
 			destination.copyHalfRightDown(sourceBlock);
 		}
 		else if(motion.halfHorizontal())
 			destination.copyHalfRight(sourceBlock);
-		else if(motion.halfHorizontal())
+		else if(motion.halfVertical())
 			destination.copyHalfDown(sourceBlock);
 		else
 			destination.copy(sourceBlock);
@@ -240,4 +274,32 @@ namespace Mpeg1
 
 		destination.correctBlock8x8(values, quadrant);
 	}
+
+	/// Copies the given values into the plane at the given block coordinates and quadrant, for
+	/// planes decoded at reduced size whose blocks are smaller than 8x8.
+	///
+	/// \param values the values to copy into the plane, a size by size matrix
+	/// \param size the width and height of a block of the plane
+	/// \param blockAddress the macroblock address in block coordinates as used elsewhere in this class
+	/// \param quadrant the quadrant as described for setBlock8x8
+	void Plane::setBlock(const int *values, int size, quint32 blockAddress, quint32 quadrant)
+	{
+		PlaneBlock destination(*this, linearAddressToPosition(blockAddress));
+
+		destination.setBlock(values, size, quadrant);
+	}
+
+	/// Corrects the values within the plane by adding the passed matrix of values to them, for
+	/// planes decoded at reduced size whose blocks are smaller than 8x8.
+	///
+	/// \param values the values to correct the plane with, a size by size matrix
+	/// \param size the width and height of a block of the plane
+	/// \param blockAddress the macroblock address in block coordinates as used elsewhere in this class
+	/// \param quadrant the quadrant as described for correctBlock8x8
+	void Plane::correctBlock(const int *values, int size, quint32 blockAddress, quint32 quadrant)
+	{
+		PlaneBlock destination(*this, linearAddressToPosition(blockAddress));
+
+		destination.correctBlock(values, size, quadrant);
+	}
 }
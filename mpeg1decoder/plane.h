@@ -15,6 +15,10 @@ namespace Mpeg1
 
 		bool allocate(const QSize &blocks, const QSize &blockSize);
 
+		bool allocateConstant(const QSize &blocks, const QSize &blockSize, qreal value);
+
+		bool isConstant() const;
+
 		const QSize &size() const;
 
 		const QSize &blockSize() const;
@@ -49,6 +53,10 @@ namespace Mpeg1
 
 		void correctBlock8x8(const int *values, quint32 blockAddress, quint32 quadrant);
 
+		void setBlock(const int *values, int size, quint32 blockAddress, quint32 quadrant);
+
+		void correctBlock(const int *values, int size, quint32 blockAddress, quint32 quadrant);
+
 	private:
 		QSize m_blocks;
 		QSize m_blockSize;
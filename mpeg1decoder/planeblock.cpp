@@ -123,4 +123,30 @@ namespace Mpeg1
 				*out++ += (qreal)(*values);
 		}
 	}
+
+	void PlaneBlock::setBlock(const int *values, int size, quint32 quadrant)
+	{
+		int offsetX = (quadrant & 0x1) ? size : 0;
+		int offsetY = (quadrant & 0x2) ? size : 0;
+
+		for(int y=0; y<size; y++)
+		{
+			qreal *out = scanLine(y + offsetY) + offsetX;
+			for(int x=0; x<size; x++, values++)
+				*out++ = (qreal)(*values);
+		}
+	}
+
+	void PlaneBlock::correctBlock(const int *values, int size, quint32 quadrant)
+	{
+		int offsetX = (quadrant & 0x1) ? size : 0;
+		int offsetY = (quadrant & 0x2) ? size : 0;
+
+		for(int y=0; y<size; y++)
+		{
+			qreal *out = scanLine(y + offsetY) + offsetX;
+			for(int x=0; x<size; x++, values++)
+				*out++ += (qreal)(*values);
+		}
+	}
 }
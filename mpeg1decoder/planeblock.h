@@ -84,6 +84,16 @@ namespace Mpeg1
 		/// \param quadrant as described above.
 		void correctBlock8x8(const int *values, quint32 quadrant);
 
+		/// Same as setBlock8x8 for the smaller blocks of a plane decoded at reduced size
+		///
+		/// \param values a size by size matrix of values to copy into the block's quadrant
+		/// \param size the width and height of a block of the plane
+		/// \param quadrant as described for setBlock8x8
+		void setBlock(const int *values, int size, quint32 quadrant);
+
+		/// Same as correctBlock8x8 for the smaller blocks of a plane decoded at reduced size
+		void correctBlock(const int *values, int size, quint32 quadrant);
+
 	private:
 		class Plane &m_plane;
 		QPoint m_position;
@@ -0,0 +1,336 @@
+#include "rawvideowriter.h"
+#include "videobuffer.h"
+#include "videopicture.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include <string.h>
+
+namespace Mpeg1
+{
+	// Pel aspect ratio (pel height / pel width) of each aspect_ratio_information code, times 10000.
+	// See ISO/IEC 11172-2 2.4.3.2
+	static const int s_pixelAspectRatios[] =
+	{
+		0, 10000, 6735, 7031, 7615, 8055, 8437, 8935, 9157, 9815, 10255, 10695, 10950, 11575, 12015
+	};
+
+	// Frames per second of each picture_rate code as a fraction
+	static const int s_pictureRates[][2] =
+	{
+		{ 0, 0 }, { 24000, 1001 }, { 24, 1 }, { 25, 1 }, { 30000, 1001 }, { 30, 1 }, { 50, 1 }, { 60000, 1001 }, { 60, 1 }
+	};
+
+	static const char s_frameMarker[] = "FRAME\n";
+	static const int FrameMarkerBytes = 6;
+
+	/// Writes the filled frame buffers of a RawVideoWriter to its device
+	class RawVideoWriterThread : public QThread
+	{
+	public:
+		RawVideoWriterThread(RawVideoWriter *writer) :
+			m_writer(writer)
+		{
+		}
+
+	protected:
+		void run()
+		{
+			m_writer->writeFrames();
+		}
+
+	private:
+		RawVideoWriter *m_writer;
+	};
+
+	RawVideoWriter::RawVideoWriter(QIODevice *output, Container container) :
+		m_output(output),
+		m_container(container),
+		m_pixelAspectRatio(0),
+		m_pictureRate(0),
+		m_pictureBytes(0),
+		m_frameBytes(0),
+		m_started(false),
+		m_error(false),
+		m_frameCount(0),
+		m_mappedFrames(0),
+		m_mapping(0),
+		m_headerBytes(0),
+		m_thread(0),
+		m_fillIndex(0),
+		m_finishing(false)
+	{
+		m_full[0] = m_full[1] = false;
+	}
+
+	RawVideoWriter::~RawVideoWriter()
+	{
+		finish();
+	}
+
+	void RawVideoWriter::setMappedFrameCount(int frameCount)
+	{
+		m_mappedFrames = qMax(frameCount, 0);
+	}
+
+	void RawVideoWriter::finish()
+	{
+		{
+			QMutexLocker locker(&m_mutex);
+			m_finishing = true;
+			m_changed.wakeAll();
+		}
+
+		if (m_thread)
+		{
+			m_thread->wait();
+			delete m_thread;
+			m_thread = 0;
+
+			m_frames[0].clear();
+			m_frames[1].clear();
+		}
+
+		if (m_mapping)
+			unmapOutput();
+	}
+
+	bool RawVideoWriter::hasError() const
+	{
+		QMutexLocker locker(&m_mutex);
+		return m_error;
+	}
+
+	int RawVideoWriter::frameCount() const
+	{
+		return m_frameCount;
+	}
+
+	void RawVideoWriter::setSize(int width, int height)
+	{
+		m_size = QSize(width, height);
+	}
+
+	void RawVideoWriter::setPixelAspectRatio(int aspectRatio)
+	{
+		m_pixelAspectRatio = aspectRatio;
+	}
+
+	void RawVideoWriter::setPictureRate(int pictureRate)
+	{
+		m_pictureRate = pictureRate;
+	}
+
+	/// Writes a picture given directly rather than by the decoder, such as one taken from a PictureQueue
+	void RawVideoWriter::pushPicture(const VideoPicture *picture, int type)
+	{
+		VideoBuffer buffer;
+		if (!acquireBuffer(picture, type, buffer))
+			return;
+
+		buffer.write(*picture, m_size);
+		pushBuffer(buffer, type);
+	}
+
+	bool RawVideoWriter::acquireBuffer(const VideoPicture * /*picture*/, int /*type*/, VideoBuffer &buffer)
+	{
+		if (!m_started && !start())
+			return false;
+
+		if (m_size != m_headerSize)
+			return false;
+
+		if (m_mapping && m_frameCount == m_mappedFrames)
+		{
+			unmapOutput();
+			startThread();
+		}
+
+		uchar *frame;
+
+		if (m_mapping)
+			frame = m_mapping + m_headerBytes + (qint64) m_frameCount * m_frameBytes;
+		else
+		{
+			QMutexLocker locker(&m_mutex);
+			while (m_full[m_fillIndex])
+				m_changed.wait(&m_mutex);
+
+			if (m_error || m_finishing)
+				return false;
+
+			frame = (uchar *) m_frames[m_fillIndex].data();
+		}
+
+		describeFrame(frame, buffer);
+		return true;
+	}
+
+	void RawVideoWriter::pushBuffer(const VideoBuffer & /*buffer*/, int /*type*/)
+	{
+		m_frameCount++;
+
+		if (m_mapping)
+			return;
+
+		QMutexLocker locker(&m_mutex);
+		m_full[m_fillIndex] = true;
+		m_fillIndex ^= 1;
+		m_changed.wakeAll();
+	}
+
+	/// Builds the YUV4MPEG2 stream header. MPEG-1 sites chroma between the luma samples, as does JPEG.
+	QByteArray RawVideoWriter::header() const
+	{
+		const int *rate = s_pictureRates[(m_pictureRate > 0 && m_pictureRate < 9) ? m_pictureRate : 0];
+
+		// Y4M gives the pixel width over height, the inverse of MPEG-1
+		int aspectNumerator = 0;
+		int aspectDenominator = 0;
+		if (m_pixelAspectRatio > 0 && m_pixelAspectRatio < 15)
+		{
+			aspectNumerator = 10000;
+			aspectDenominator = s_pixelAspectRatios[m_pixelAspectRatio];
+		}
+
+		if (aspectNumerator == aspectDenominator && aspectNumerator)
+			aspectNumerator = aspectDenominator = 1;
+
+		return QByteArray("YUV4MPEG2 W") + QByteArray::number(m_size.width()) +
+			" H" + QByteArray::number(m_size.height()) +
+			" F" + QByteArray::number(rate[0]) + ":" + QByteArray::number(rate[1]) +
+			" Ip A" + QByteArray::number(aspectNumerator) + ":" + QByteArray::number(aspectDenominator) +
+			" C420jpeg\n";
+	}
+
+	/// Writes the stream header once the first picture arrives, when every stream parameter is known
+	bool RawVideoWriter::start()
+	{
+		m_started = true;
+		m_headerSize = m_size;
+
+		int chromaBytes = ((m_size.width() + 1) >> 1) * ((m_size.height() + 1) >> 1);
+		m_pictureBytes = m_size.width() * m_size.height() + 2 * chromaBytes;
+		m_frameBytes = m_pictureBytes + (m_container == ContainerY4m ? FrameMarkerBytes : 0);
+
+		QByteArray fileHeader;
+		if (m_container == ContainerY4m)
+			fileHeader = header();
+		m_headerBytes = fileHeader.size();
+
+		if (m_mappedFrames && mapOutput(fileHeader))
+			return true;
+
+		if (m_output->write(fileHeader) != fileHeader.size())
+		{
+			m_error = true;
+			return false;
+		}
+
+		startThread();
+		return true;
+	}
+
+	void RawVideoWriter::startThread()
+	{
+		m_frames[0].resize(m_frameBytes);
+		m_frames[1].resize(m_frameBytes);
+
+		m_thread = new RawVideoWriterThread(this);
+		m_thread->start();
+	}
+
+	/// Grows the output file to the header and m_mappedFrames frames and maps it
+	bool RawVideoWriter::mapOutput(const QByteArray &fileHeader)
+	{
+		QFile *file = qobject_cast<QFile *>(m_output);
+		if (!file)
+			return false;
+
+		qint64 size = m_headerBytes + (qint64) m_mappedFrames * m_frameBytes;
+		if (!file->resize(size))
+			return false;
+
+		m_mapping = file->map(0, size);
+		if (!m_mapping)
+		{
+			file->resize(0);
+			return false;
+		}
+
+		memcpy(m_mapping, fileHeader.constData(), m_headerBytes);
+		return true;
+	}
+
+	/// Unmaps the output file, cutting it to the frames written and moving to its end
+	void RawVideoWriter::unmapOutput()
+	{
+		QFile *file = static_cast<QFile *>(m_output);
+		qint64 size = m_headerBytes + (qint64) m_frameCount * m_frameBytes;
+
+		file->unmap(m_mapping);
+		m_mapping = 0;
+
+		if (!file->resize(size) || !file->seek(size))
+		{
+			QMutexLocker locker(&m_mutex);
+			m_error = true;
+		}
+	}
+
+	/// Lays the I420 planes out in a frame, after the FRAME marker of a Y4M stream
+	void RawVideoWriter::describeFrame(uchar *frame, VideoBuffer &buffer) const
+	{
+		if (m_container == ContainerY4m)
+		{
+			memcpy(frame, s_frameMarker, FrameMarkerBytes);
+			frame += FrameMarkerBytes;
+		}
+
+		int chromaWidth = (m_size.width() + 1) >> 1;
+		int chromaHeight = (m_size.height() + 1) >> 1;
+
+		buffer.format = VideoBuffer::FormatI420;
+		buffer.data[0] = frame;
+		buffer.stride[0] = m_size.width();
+		buffer.data[1] = buffer.data[0] + m_size.width() * m_size.height();
+		buffer.stride[1] = chromaWidth;
+		buffer.data[2] = buffer.data[1] + chromaWidth * chromaHeight;
+		buffer.stride[2] = chromaWidth;
+		buffer.context = frame;
+	}
+
+	/// The writer thread. Writes the frame buffers in the order they are filled until finish().
+	///
+	/// After a failed write the frames are still taken, and dropped, so the decoder never waits on
+	/// a buffer that will not be freed.
+	void RawVideoWriter::writeFrames()
+	{
+		int index = 0;
+
+		QMutexLocker locker(&m_mutex);
+
+		for(;;)
+		{
+			while (!m_full[index] && !m_finishing)
+				m_changed.wait(&m_mutex);
+
+			if (!m_full[index])
+				break;
+
+			bool failed = m_error;
+			locker.unlock();
+
+			if (!failed && m_output->write(m_frames[index].constData(), m_frameBytes) != m_frameBytes)
+				failed = true;
+
+			locker.relock();
+			m_error = failed;
+			m_full[index] = false;
+			index ^= 1;
+			m_changed.wakeAll();
+		}
+	}
+}
@@ -0,0 +1,132 @@
+#if !defined(MPEG1_RAWVIDEOWRITER_H)
+#define MPEG1_RAWVIDEOWRITER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QSize>
+#include <QtCore/QWaitCondition>
+
+#include "videorenderer.h"
+
+namespace Mpeg1
+{
+	/// A VideoRenderer writing the decoded pictures as uncompressed I420 to a file or a pipe.
+	///
+	/// This lets batch pipelines decode to disk or stdout without any GUI. The output is either raw
+	/// I420 frames back to back or a YUV4MPEG2 stream, whose header is built from the stream
+	/// parameters given by the decoder.
+	///
+	/// The decoder writes each picture straight into one of two frame buffers (see acquireBuffer()),
+	/// and a thread of the writer writes the previous frame to the device meanwhile, so the decoder
+	/// only waits on the device when it is slower than decoding. When given a file and the number of
+	/// frames to expect, the file is instead grown up front and mapped, and the decoder writes the
+	/// pictures into the mapping without any copy or system call.
+	///
+	/// Only pictures of the size of the first sequence can be written, as neither format can
+	/// describe a change of size. Pictures of another size are dropped.
+	class RawVideoWriter : public VideoRenderer
+	{
+	public:
+		enum Container
+		{
+			ContainerRaw,		//< I420 frames with nothing in between
+			ContainerY4m		//< A YUV4MPEG2 header and a FRAME marker before each frame
+		};
+
+		/// Constructs the writer
+		///
+		/// \param output the open device to write to, which must outlive the writer
+		/// \param container the format of the output
+		RawVideoWriter(class QIODevice *output, Container container = ContainerY4m);
+
+		/// Destructor. Calls finish().
+		~RawVideoWriter();
+
+		/// Writes into a mapping of the output file instead of through the writer thread.
+		///
+		/// The output must be a QFile opened for reading and writing, as mapping requires, and is
+		/// written from its start. It is grown to hold the given number of frames when the first
+		/// picture arrives and cut back to what was written by finish(). Should more pictures arrive,
+		/// the writer unmaps the file and carries on through its thread. Must be called before
+		/// decoding.
+		///
+		/// \param frameCount the number of frames to make room for, 0 to write through the thread
+		void setMappedFrameCount(int frameCount);
+
+		/// Waits for every frame to be written and releases the buffers or the mapping.
+		///
+		/// Must be called once the decoder has returned, before the device is closed.
+		void finish();
+
+		/// Returns true if the output could not be written
+		bool hasError() const;
+
+		/// Returns the number of frames written
+		int frameCount() const;
+
+		void setSize(int width, int height);
+
+		void pushPicture(const VideoPicture *picture, int type);
+
+		void setPixelAspectRatio(int aspectRatio);
+
+		void setPictureRate(int pictureRate);
+
+		bool acquireBuffer(const VideoPicture *picture, int type, VideoBuffer &buffer);
+
+		void pushBuffer(const VideoBuffer &buffer, int type);
+
+	private:
+		Q_DISABLE_COPY(RawVideoWriter)
+
+		friend class RawVideoWriterThread;
+
+		QByteArray header() const;
+
+		bool start();
+
+		void startThread();
+
+		bool mapOutput(const QByteArray &fileHeader);
+
+		void unmapOutput();
+
+		void describeFrame(uchar *frame, VideoBuffer &buffer) const;
+
+		void writeFrames();
+
+	private:
+		class QIODevice *m_output;
+		Container m_container;
+
+		QSize m_size;
+		QSize m_headerSize;
+		int m_pixelAspectRatio;
+		int m_pictureRate;
+
+		// Bytes of the I420 picture, and the total including any FRAME marker
+		int m_pictureBytes;
+		int m_frameBytes;
+
+		bool m_started;
+		bool m_error;
+		int m_frameCount;
+
+		// Mapped output
+		int m_mappedFrames;
+		uchar *m_mapping;
+		qint64 m_headerBytes;
+
+		// Double buffered output. The decoder fills m_frames[m_fillIndex] while the thread writes
+		// the other one. m_full tells which of them are waiting to be written.
+		class RawVideoWriterThread *m_thread;
+		QByteArray m_frames[2];
+		bool m_full[2];
+		int m_fillIndex;
+		bool m_finishing;
+		mutable QMutex m_mutex;
+		QWaitCondition m_changed;
+	};
+}
+
+#endif
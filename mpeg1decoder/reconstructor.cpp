@@ -0,0 +1,164 @@
+#include "reconstructor.h"
+#include "idct.h"
+#include "macroblockbatch.h"
+#include "videopicture.h"
+
+#include "utility.h"
+
+#include <QtCore/QPoint>
+
+namespace Mpeg1
+{
+	static int s_nullMatrix[64] =
+	{
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0
+	};
+
+	void Reconstructor::reconstruct(const MacroblockBatch &batch)
+	{
+		for(int row = 0; row < batch.rowCount(); row++)
+		{
+			waitForReferences(batch, row);
+			reconstructRow(batch, row);
+
+			batch.picture()->setDecodedRows(row + 1);
+		}
+	}
+
+	/// The vertical reach of a vector is bounded by the f_code of the picture, so a row only ever
+	/// needs the anchor rows a little below it. The exact reach is taken from the parsed vectors.
+	int Reconstructor::referenceRows(const MacroblockBatch &batch, int row, bool backward)
+	{
+		int lastLine = -1;
+
+		const Macroblock *macroblocks = batch.macroblocks(row);
+		for(int i = 0; i < batch.count(row); i++)
+		{
+			const Macroblock &macroblock = macroblocks[i];
+
+			int down;
+			if(macroblock.prediction == Macroblock::PredictionBidirectional)
+				down = backward ? macroblock.backwardDown : macroblock.forwardDown;
+			else if(macroblock.prediction == Macroblock::PredictionForward && !backward)
+				down = macroblock.forwardDown;
+			else if(macroblock.prediction == Macroblock::PredictionBackward && backward)
+				down = macroblock.backwardDown;
+			else
+				continue;
+
+			// Last luma line read, including the line below for half pel averaging
+			int top = (int)(macroblock.address / batch.picture()->luma().blocks().width()) * 16;
+			int line = top + 15 + (down >> 1) + (down & 1);
+
+			// The chroma vector is half the luma vector, on a plane of half the height
+			int chromaDown = down >> 1;
+			int chromaLine = (top >> 1) + 7 + (chromaDown >> 1) + (chromaDown & 1);
+
+			lastLine = qMax(lastLine, qMax(line, chromaLine * 2 + 1));
+		}
+
+		if(lastLine < 0)
+			return 0;
+
+		return qMin(lastLine / 16 + 1, batch.rowCount());
+	}
+
+	void Reconstructor::waitForReferences(const MacroblockBatch &batch, int row)
+	{
+		if(batch.previous())
+			batch.previous()->waitForDecodedRows(referenceRows(batch, row, false));
+		if(batch.future())
+			batch.future()->waitForDecodedRows(referenceRows(batch, row, true));
+	}
+
+	void Reconstructor::reconstructRow(const MacroblockBatch &batch, int row)
+	{
+		const Macroblock *macroblocks = batch.macroblocks(row);
+		const Coefficient *coefficients = batch.coefficients(row);
+
+		for(int i = 0; i < batch.count(row); i++)
+			reconstruct(batch, macroblocks[i], coefficients);
+	}
+
+	void Reconstructor::reconstruct(const MacroblockBatch &batch, const Macroblock &macroblock, const Coefficient *coefficients)
+	{
+		VideoPicture *picture = batch.picture();
+
+		QPoint forward(macroblock.forwardRight, macroblock.forwardDown);
+		QPoint backward(macroblock.backwardRight, macroblock.backwardDown);
+
+		switch(macroblock.prediction)
+		{
+		case Macroblock::PredictionForward:
+			picture->compensate(*batch.previous(), macroblock.address, forward);
+			break;
+
+		case Macroblock::PredictionBackward:
+			picture->compensate(*batch.future(), macroblock.address, backward);
+			break;
+
+		case Macroblock::PredictionBidirectional:
+			picture->interpolate(*batch.previous(), forward, *batch.future(), backward, macroblock.address);
+			break;
+		}
+
+		// The Coded Block Pattern informs the decoder which of the six blocks 
+		// in the macroblock are coded, i.e. have transmitted DCT quantized 
+		// coefficients, and which are not coded, i.e. have no additional 
+		// correction after motion compensation
+		const Coefficient *coefficient = coefficients + macroblock.firstCoefficient;
+		int dctRecon[64];
+
+		// Pictures decoded at reduced size have smaller blocks, from the low frequencies only
+		int blockSize = picture->chromaBlue().blockSize().width();
+
+		for (int i = 0; i < 6; i++)
+		{
+			if ((macroblock.codedBlockPattern & (1 << (5 - i))) == 0) 
+				continue;
+
+			Plane &plane = (i < 4) ? picture->luma() : ((i == 4) ? picture->chromaBlue() : picture->chromaRed());
+			quint32 quadrant = (i < 4) ? i : 0;
+
+			if (blockSize < Idct::DctSize)
+			{
+				// The parser only keeps the coefficients which fit the block
+				copyInts(s_nullMatrix, 0, dctRecon, 0, blockSize * blockSize);
+				for (int j = 0; j < macroblock.coefficientCount[i]; j++, coefficient++)
+					dctRecon[(coefficient->position >> 3) * blockSize + (coefficient->position & 7)] = coefficient->value;
+
+				if (blockSize == 4)
+					Idct::calculate4x4(dctRecon);
+				else if (blockSize == 2)
+					Idct::calculate2x2(dctRecon);
+				else
+					dctRecon[0] = Idct::calculateDc(dctRecon[0]);
+
+				if (macroblock.prediction == Macroblock::PredictionNone)
+					plane.setBlock(dctRecon, blockSize, macroblock.address, quadrant);
+				else
+					plane.correctBlock(dctRecon, blockSize, macroblock.address, quadrant);
+
+				continue;
+			}
+
+			copyInts(s_nullMatrix, 0, dctRecon, 0, 64);
+			for (int j = 0; j < macroblock.coefficientCount[i]; j++, coefficient++)
+				dctRecon[coefficient->position] = coefficient->value;
+
+			Idct::calculate(dctRecon);
+
+			if (macroblock.prediction == Macroblock::PredictionNone)
+				plane.setBlock8x8(dctRecon, macroblock.address, quadrant);
+			else
+				plane.correctBlock8x8(dctRecon, macroblock.address, quadrant);
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#if !defined(MPEG1_RECONSTRUCTOR_H)
+#define MPEG1_RECONSTRUCTOR_H
+
+#include <QtCore/Qt>
+
+namespace Mpeg1
+{
+	/// Performs the pixel work of decoding : motion compensation and the inverse DCT.
+	///
+	/// This is the second stage of the decoder. It works entirely from a MacroblockBatch produced by
+	/// PictureDecoder and never touches the bitstream, so it can run on any thread once the anchors
+	/// the batch predicts from are complete.
+	class Reconstructor
+	{
+	public:
+		/// Reconstructs every macroblock of the batch into its picture from the top, waiting for the
+		/// anchors to be decoded as far as each row needs and marking each row as decoded.
+		static void reconstruct(const class MacroblockBatch &batch);
+
+		/// Returns the number of rows from the top of an anchor which a row of the batch reads
+		///
+		/// \param batch the parsed picture
+		/// \param row the macroblock row of the picture
+		/// \param backward true for the future anchor, false for the previous anchor
+		static int referenceRows(const class MacroblockBatch &batch, int row, bool backward);
+
+		/// Blocks until the anchors of the batch are decoded as far as the given row reads them
+		static void waitForReferences(const class MacroblockBatch &batch, int row);
+
+		/// Reconstructs every macroblock of a row without waiting for anything. The anchors must be
+		/// complete as far as the row predicts from them.
+		static void reconstructRow(const class MacroblockBatch &batch, int row);
+
+		/// Reconstructs a single macroblock.
+		///
+		/// \param coefficients the coefficients of the row of the macroblock
+		static void reconstruct(const class MacroblockBatch &batch, const struct Macroblock &macroblock, const struct Coefficient *coefficients);
+	};
+}
+
+#endif
@@ -0,0 +1,163 @@
+#if !defined(MPEG1_RINGBUFFER_H)
+#define MPEG1_RINGBUFFER_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QWaitCondition>
+
+namespace Mpeg1
+{
+	/// A bounded single producer, single consumer queue.
+	///
+	/// Pushing and popping are lock free : the producer only ever writes the tail index and the
+	/// consumer only ever writes the head index. The mutex and wait condition are only used by
+	/// push() and pop() to sleep when the queue is full or empty, and are only touched by the other
+	/// side when it knows somebody is asleep.
+	///
+	/// Exactly one thread may push and exactly one thread may pop.
+	template <typename T> class RingBuffer
+	{
+	public:
+		/// Constructs the queue
+		///
+		/// \param capacity the maximum number of items queued. Rounded up to a power of two.
+		RingBuffer(int capacity) :
+			m_head(0),
+			m_tail(0),
+			m_waiting(0)
+		{
+			int size = 1;
+			while(size < capacity)
+				size <<= 1;
+
+			m_items = new T[size];
+			m_mask = size - 1;
+		}
+
+		~RingBuffer()
+		{
+			delete [] m_items;
+		}
+
+		/// Returns the maximum number of items which can be queued
+		int capacity() const
+		{
+			return m_mask + 1;
+		}
+
+		/// Returns the number of items queued. Only exact when called from the producer or consumer.
+		int count() const
+		{
+			return (int)((uint) m_tail.fetchAndAddAcquire(0) - (uint) m_head.fetchAndAddAcquire(0));
+		}
+
+		/// Queues an item if there is room. Producer only.
+		///
+		/// \return false if the queue is full
+		bool tryPush(const T &item)
+		{
+			if(!pushItem(item))
+				return false;
+
+			wakeWaiting();
+			return true;
+		}
+
+		/// Dequeues an item if there is one. Consumer only.
+		///
+		/// \return false if the queue is empty
+		bool tryPop(T &item)
+		{
+			if(!popItem(item))
+				return false;
+
+			wakeWaiting();
+			return true;
+		}
+
+		/// Queues an item, sleeping while the queue is full. Producer only.
+		void push(const T &item)
+		{
+			if(!pushItem(item))
+			{
+				QMutexLocker locker(&m_mutex);
+				m_waiting.fetchAndAddOrdered(1);
+				while(!pushItem(item))
+					m_changed.wait(&m_mutex);
+				m_waiting.fetchAndAddOrdered(-1);
+			}
+
+			wakeWaiting();
+		}
+
+		/// Dequeues an item, sleeping while the queue is empty. Consumer only.
+		T pop()
+		{
+			T item;
+			if(!popItem(item))
+			{
+				QMutexLocker locker(&m_mutex);
+				m_waiting.fetchAndAddOrdered(1);
+				while(!popItem(item))
+					m_changed.wait(&m_mutex);
+				m_waiting.fetchAndAddOrdered(-1);
+			}
+
+			wakeWaiting();
+			return item;
+		}
+
+	private:
+		bool pushItem(const T &item)
+		{
+			int tail = m_tail.fetchAndAddRelaxed(0);
+			if((uint) tail - (uint) m_head.fetchAndAddAcquire(0) > (uint) m_mask)
+				return false;
+
+			m_items[tail & m_mask] = item;
+			m_tail.fetchAndStoreOrdered(tail + 1);
+			return true;
+		}
+
+		bool popItem(T &item)
+		{
+			int head = m_head.fetchAndAddRelaxed(0);
+			if(head == m_tail.fetchAndAddAcquire(0))
+				return false;
+
+			item = m_items[head & m_mask];
+			m_items[head & m_mask] = T();
+			m_head.fetchAndStoreOrdered(head + 1);
+			return true;
+		}
+
+		/// Wakes the other side if it went to sleep waiting for the change which was just made.
+		///
+		/// The index stores and the check of m_waiting are full barriers, so either the sleeper sees
+		/// the change when it checks again before waiting or this sees the sleeper.
+		void wakeWaiting()
+		{
+			if(m_waiting.fetchAndAddOrdered(0) == 0)
+				return;
+
+			QMutexLocker locker(&m_mutex);
+			m_changed.wakeAll();
+		}
+
+	private:
+		Q_DISABLE_COPY(RingBuffer)
+
+		T *m_items;
+		int m_mask;
+
+		mutable QAtomicInt m_head;		// Next item to pop, written by the consumer
+		mutable QAtomicInt m_tail;		// Next item to push, written by the producer
+
+		QAtomicInt m_waiting;
+		QMutex m_mutex;
+		QWaitCondition m_changed;
+	};
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "rowscheduler.h"
+#include "macroblockbatch.h"
+#include "reconstructor.h"
+#include "videopicture.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QVector>
+
+namespace Mpeg1
+{
+	/// Tracks the reconstruction of the rows of one picture.
+	///
+	/// The parser and every row job in flight each hold a reference. The last one to finish deletes
+	/// the batch, which releases the picture and its anchors.
+	class PictureReconstruction : public BatchListener
+	{
+	public:
+		PictureReconstruction(MacroblockBatch *batch, Executor::Stream *stream) :
+			m_batch(batch),
+			m_stream(stream),
+			m_references(1),
+			m_done(batch->rowCount(), false),
+			m_decodedRows(0)
+		{
+			m_batch->setListener(this);
+		}
+
+		~PictureReconstruction()
+		{
+			delete m_batch;
+		}
+
+		void rowsParsed(int first, int count);
+
+		void parsingFinished()
+		{
+			release();
+		}
+
+		/// Called by a worker to reconstruct one row
+		void reconstructRow(int row)
+		{
+			// The anchor is usually still being reconstructed a few rows further down
+			Reconstructor::waitForReferences(*m_batch, row);
+			Reconstructor::reconstructRow(*m_batch, row);
+
+			rowFinished(row);
+			release();
+		}
+
+	private:
+		void rowFinished(int row)
+		{
+			QMutexLocker locker(&m_mutex);
+
+			m_done[row] = true;
+
+			int decodedRows = m_decodedRows;
+			while(decodedRows < m_done.count() && m_done.at(decodedRows))
+				decodedRows++;
+
+			if(decodedRows == m_decodedRows)
+				return;
+
+			m_decodedRows = decodedRows;
+			m_batch->picture()->setDecodedRows(decodedRows);
+		}
+
+		void release()
+		{
+			if(!m_references.deref())
+				delete this;
+		}
+
+	private:
+		MacroblockBatch *m_batch;
+		Executor::Stream *m_stream;
+
+		QAtomicInt m_references;
+
+		QMutex m_mutex;
+		QVector<bool> m_done;
+		int m_decodedRows;
+	};
+
+	/// Reconstructs one macroblock row on a worker thread
+	class RowJob : public QRunnable
+	{
+	public:
+		RowJob(PictureReconstruction *reconstruction, int row) :
+			m_reconstruction(reconstruction),
+			m_row(row)
+		{
+		}
+
+		void run()
+		{
+			m_reconstruction->reconstructRow(m_row);
+		}
+
+	private:
+		PictureReconstruction *m_reconstruction;
+		int m_row;
+	};
+
+	void PictureReconstruction::rowsParsed(int first, int count)
+	{
+		for(int row = first; row < first + count; row++)
+		{
+			m_references.ref();
+			m_stream->start(new RowJob(this, row));
+		}
+	}
+
+	RowScheduler::RowScheduler(Executor::Stream *stream) :
+		m_stream(stream)
+	{
+	}
+
+	RowScheduler::~RowScheduler()
+	{
+		waitForDone();
+	}
+
+	void RowScheduler::schedule(MacroblockBatch *batch)
+	{
+		new PictureReconstruction(batch, m_stream);
+	}
+
+	void RowScheduler::waitForDone()
+	{
+		m_stream->waitForDone();
+	}
+}
@@ -0,0 +1,50 @@
+#if !defined(MPEG1_ROWSCHEDULER_H)
+#define MPEG1_ROWSCHEDULER_H
+
+#include <QtCore/Qt>
+
+#include "executor.h"
+
+namespace Mpeg1
+{
+	/// Reconstructs pictures row by row on the workers of an Executor.
+	///
+	/// Once a macroblock has been parsed its reconstruction only reads the anchors, never the picture
+	/// being reconstructed, so every macroblock row is independent of the others. The scheduler
+	/// listens to a MacroblockBatch while it is being parsed and hands each row to a worker as soon
+	/// as the parser has moved past it. The picture becomes ready row by row, its decoded row count
+	/// always being the number of contiguous rows complete from the top.
+	///
+	/// This lets streams with a single slice per picture, where slices can't be decoded in
+	/// parallel, still spread the pixel work of a picture over every core.
+	///
+	/// A row only waits for the rows of its anchors its motion vectors reach into, which the f_code
+	/// keeps to a few rows below it. The next P picture is therefore reconstructed a few rows behind
+	/// the one it predicts from rather than after it, pipelining IPPP streams across pictures.
+	class RowScheduler
+	{
+	public:
+		/// Constructs the scheduler
+		///
+		/// \param stream the executor stream the rows are run on
+		RowScheduler(Executor::Stream *stream);
+
+		/// Destructor. Waits for every scheduled row to be reconstructed
+		~RowScheduler();
+
+		/// Reconstructs the rows of a batch as the parser completes them. Must be called before the
+		/// first macroblock is added to the batch. Ownership of the batch passes to the scheduler,
+		/// which deletes it once it has been parsed and reconstructed.
+		void schedule(class MacroblockBatch *batch);
+
+		/// Waits for every scheduled row to be reconstructed
+		void waitForDone();
+
+	private:
+		Q_DISABLE_COPY(RowScheduler)
+
+		Executor::Stream *m_stream;
+	};
+}
+
+#endif
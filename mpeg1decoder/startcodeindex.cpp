@@ -0,0 +1,441 @@
+#include "startcodeindex.h"
+#include "executor.h"
+#include "startcodes.h"
+#include "videopicture.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+
+#include <string.h>
+
+namespace Mpeg1
+{
+	static const int ScanBufferSize = 1 << 20;
+
+	// Most groups of pictures are found within the first read when resynchronizing
+	static const int ResyncBufferSize = 1 << 16;
+
+	// A start code and the longest header kept from it, the sequence header's
+	static const int MaximumHeaderLength = 4 + 7;
+
+	// Chunks scanned in parallel are large enough for the reads to stay sequential on disk
+	static const qint64 MinimumChunkSize = 16 << 20;
+
+	/// Scans one chunk of a file on a worker, reading it through its own QFile
+	class ChunkScan : public QRunnable
+	{
+	public:
+		ChunkScan(const QString &fileName, qint64 begin, qint64 end) :
+			m_file(fileName),
+			m_begin(begin),
+			m_end(end),
+			m_result(false)
+		{
+			setAutoDelete(false);
+		}
+
+		void run()
+		{
+			m_result = m_file.open(QIODevice::ReadOnly) && StartCodeIndex::scanRange(&m_file, m_begin, m_end, m_entries);
+		}
+
+		QVector<StartCodeIndex::Entry> &entries()
+		{
+			return m_entries;
+		}
+
+		bool result() const
+		{
+			return m_result;
+		}
+
+	private:
+		QFile m_file;
+		qint64 m_begin;
+		qint64 m_end;
+
+		QVector<StartCodeIndex::Entry> m_entries;
+		bool m_result;
+	};
+
+	StartCodeIndex::StartCodeIndex() :
+		m_streamSize(0)
+	{
+	}
+
+	bool StartCodeIndex::build(QIODevice *device, Executor *executor)
+	{
+		clear();
+
+		qint64 position = device->pos();
+		qint64 size = device->size();
+
+		QFile *file = qobject_cast<QFile *>(device);
+
+		bool result;
+		if(executor && file && !file->fileName().isEmpty() && size >= 2 * MinimumChunkSize)
+			result = buildParallel(file->fileName(), size, executor);
+		else
+			result = scanRange(device, 0, size, m_entries);
+
+		device->seek(position);
+
+		if(!result)
+		{
+			clear();
+			return false;
+		}
+
+		m_streamSize = size;
+
+		buildGroups();
+		return true;
+	}
+
+	/// Scans a file in chunks on the workers of an executor and merges their entries in order
+	bool StartCodeIndex::buildParallel(const QString &fileName, qint64 size, Executor *executor)
+	{
+		int chunkCount = (int) qMin((qint64) executor->threadCount() * 2, size / MinimumChunkSize);
+		qint64 chunkSize = size / chunkCount;
+
+		QVector<ChunkScan *> chunks;
+		Executor::Stream stream(executor);
+
+		for(int i = 0; i < chunkCount; i++)
+		{
+			qint64 begin = i * chunkSize;
+			qint64 end = (i == chunkCount - 1) ? size : begin + chunkSize;
+
+			chunks.append(new ChunkScan(fileName, begin, end));
+			stream.start(chunks.last());
+		}
+
+		stream.waitForDone();
+
+		bool result = true;
+		for(int i = 0; i < chunks.count(); i++)
+		{
+			result = result && chunks.at(i)->result();
+			if(result)
+				m_entries += chunks.at(i)->entries();
+
+			delete chunks.at(i);
+		}
+
+		return result;
+	}
+
+	bool StartCodeIndex::scanRange(QIODevice *device, qint64 begin, qint64 end, QVector<Entry> &entries)
+	{
+		if(!device->seek(begin))
+			return false;
+
+		// Read just far enough past the end for the header of a start code beginning right before it
+		qint64 size = device->size();
+		qint64 stop = qMin(end + MaximumHeaderLength, size);
+
+		QByteArray buffer(ScanBufferSize, 0);
+		uchar *data = (uchar *) buffer.data();
+
+		int pending = 0;
+		qint64 offset = begin;
+		int first = entries.count();
+
+		for(;;)
+		{
+			qint64 read = device->read((char *)(data + pending), qMin((qint64)(ScanBufferSize - pending), stop - offset - pending));
+			if(read < 0)
+				return false;
+
+			qint64 length = read + pending;
+
+			// A device holding less than its size says (a truncated or shrinking file) ends where reads do
+			bool ended = read == 0;
+			bool last = ended || offset + length >= stop;
+			int consumed = scan(data, (int) length, offset, last && (ended || stop == size), entries);
+
+			if(last)
+				break;
+
+			// Present whatever could not be scanned yet again at the start of the next buffer
+			pending = (int) length - consumed;
+			memmove(data, data + consumed, pending);
+			offset += consumed;
+		}
+
+		// Start codes in the bytes read past the end belong to the next range
+		while(entries.count() > first && entries.last().offset >= end)
+			entries.remove(entries.count() - 1);
+
+		return true;
+	}
+
+	void StartCodeIndex::clear()
+	{
+		m_entries.clear();
+		m_groups.clear();
+		m_streamSize = 0;
+	}
+
+	int StartCodeIndex::count() const
+	{
+		return m_entries.count();
+	}
+
+	const StartCodeIndex::Entry &StartCodeIndex::at(int index) const
+	{
+		return m_entries.at(index);
+	}
+
+	const QVector<StartCodeIndex::Entry> &StartCodeIndex::entries() const
+	{
+		return m_entries;
+	}
+
+	qint64 StartCodeIndex::streamSize() const
+	{
+		return m_streamSize;
+	}
+
+	qint64 StartCodeIndex::endOffset(int index) const
+	{
+		if(index + 1 < m_entries.count())
+			return m_entries.at(index + 1).offset;
+
+		return m_streamSize;
+	}
+
+	int StartCodeIndex::sequenceHeaderFor(int index) const
+	{
+		for(int i = index; i >= 0; i--)
+		{
+			if(m_entries.at(i).code == StartCodes::SequenceHeaderCode)
+				return i;
+		}
+
+		return -1;
+	}
+
+	const QVector<StartCodeIndex::Group> &StartCodeIndex::groups() const
+	{
+		return m_groups;
+	}
+
+	int StartCodeIndex::findGroup(int frame) const
+	{
+		int low = 0;
+		int high = m_groups.count() - 1;
+
+		while(low <= high)
+		{
+			int middle = (low + high) / 2;
+			const Group &group = m_groups.at(middle);
+
+			if(frame < group.firstFrame)
+				high = middle - 1;
+			else if(frame >= group.firstFrame + group.frameCount)
+				low = middle + 1;
+			else
+				return middle;
+		}
+
+		return -1;
+	}
+
+	int StartCodeIndex::frameCount() const
+	{
+		if(m_groups.isEmpty())
+			return 0;
+
+		const Group &last = m_groups.last();
+		return qMax(last.firstFrame + last.frameCount, 0);
+	}
+
+	int StartCodeIndex::scanToGroup(QIODevice *device, qint64 offset, qint64 maximumLength, QVector<Entry> &entries)
+	{
+		entries.clear();
+
+		if(!device->seek(offset))
+			return -1;
+
+		QByteArray buffer(ResyncBufferSize, 0);
+		uchar *data = (uchar *) buffer.data();
+
+		int pending = 0;
+		qint64 read = 0;
+		int searched = 0;
+		int group = -1;
+
+		for(;;)
+		{
+			qint64 chunk = device->read((char *)(data + pending), qMin((qint64)(ResyncBufferSize - pending), maximumLength - read));
+			if(chunk < 0)
+				return -1;
+
+			read += chunk;
+			qint64 length = chunk + pending;
+
+			bool last = chunk == 0 || device->atEnd();
+			int consumed = scan(data, (int) length, offset, last, entries);
+
+			for(; group < 0 && searched < entries.count(); searched++)
+			{
+				if(entries.at(searched).code == StartCodes::GroupStartCode)
+					group = searched;
+			}
+
+			// The picture after the group header tells how many leading pictures the group has
+			if(group >= 0 && (group + 1 < entries.count() || last))
+				return group;
+
+			if(last || read >= maximumLength)
+				return -1;
+
+			pending = (int) length - consumed;
+			memmove(data, data + consumed, pending);
+			offset += consumed;
+		}
+	}
+
+	/// Finds the groups of pictures of the stream and numbers their frames in display order
+	void StartCodeIndex::buildGroups()
+	{
+		int anchorTemporalReference = -1;
+
+		for(int i = 0; i < m_entries.count(); i++)
+		{
+			const Entry &entry = m_entries.at(i);
+
+			if(entry.code == StartCodes::GroupStartCode)
+			{
+				// A sequence header right before the group belongs to it
+				if(!m_groups.isEmpty() && m_groups.last().end == m_streamSize)
+				{
+					bool headerFirst = m_entries.at(i - 1).code == StartCodes::SequenceHeaderCode;
+					m_groups.last().end = headerFirst ? m_entries.at(i - 1).offset : entry.offset;
+				}
+
+				Group group;
+				group.entry = i;
+				group.end = m_streamSize;
+				group.firstFrame = 0;
+				group.frameCount = 0;
+				group.leadingFrames = 0;
+				group.closed = entry.closedGop;
+				m_groups.append(group);
+
+				anchorTemporalReference = -1;
+			}
+			else if(entry.code == StartCodes::PictureStartCode && !m_groups.isEmpty())
+			{
+				Group &group = m_groups.last();
+				group.frameCount++;
+
+				// B pictures displayed before the first anchor of the group
+				if(entry.pictureType != VideoPicture::PictureCodingB)
+				{
+					if(anchorTemporalReference < 0)
+						anchorTemporalReference = entry.temporalReference;
+				}
+				else if(entry.temporalReference < anchorTemporalReference)
+					group.leadingFrames++;
+			}
+			else if(entry.code == StartCodes::SequenceEndCode && !m_groups.isEmpty())
+				m_groups.last().end = entry.offset;
+		}
+
+		// Nothing precedes the first group, so the decoder never outputs its leading pictures
+		int frame = 0;
+		for(int i = 0; i < m_groups.count(); i++)
+		{
+			Group &group = m_groups[i];
+			if(i == 0 && !group.closed)
+				frame = -group.leadingFrames;
+
+			group.firstFrame = frame;
+			frame += group.frameCount;
+		}
+	}
+
+	int StartCodeIndex::scan(const uchar *data, int length, qint64 offset, bool last, QVector<Entry> &entries)
+	{
+		int i = 0;
+
+		while(i + 4 <= length)
+		{
+			// Look for the 0x01 of the prefix, leaving room for the byte holding the start code value
+			const uchar *one = (const uchar *) memchr(data + i + 2, 0x01, length - i - 3);
+			if(!one)
+			{
+				i = length - 3;
+				break;
+			}
+
+			int position = (int)(one - data) - 2;
+			if(data[position] != 0 || data[position + 1] != 0)
+			{
+				i = position + 1;
+				continue;
+			}
+
+			int code = 0x100 | data[position + 3];
+
+			int headerSize = 0;
+			if(code == StartCodes::SequenceHeaderCode)
+				headerSize = 7;
+			else if(code == StartCodes::GroupStartCode)
+				headerSize = 4;
+			else if(code == StartCodes::PictureStartCode)
+				headerSize = 2;
+			else if(code != StartCodes::SequenceEndCode)
+			{
+				// Slices, user data and extensions aren't indexed, see the class documentation
+				i = position + 4;
+				continue;
+			}
+
+			bool complete = position + 4 + headerSize <= length;
+			if(!complete && !last)
+				return position;
+
+			Entry entry;
+			entry.offset = offset + position;
+			entry.code = code;
+			entry.timeCode = 0;
+			entry.closedGop = false;
+			entry.brokenLink = false;
+			entry.temporalReference = 0;
+			entry.pictureType = 0;
+			entry.pictureRate = 0;
+			entry.bitRate = 0;
+
+			const uchar *header = data + position + 4;
+			if(complete && code == StartCodes::GroupStartCode)
+			{
+				entry.timeCode = (header[0] << 17) | (header[1] << 9) | (header[2] << 1) | (header[3] >> 7);
+				entry.closedGop = (header[3] & 0x40) != 0;
+				entry.brokenLink = (header[3] & 0x20) != 0;
+			}
+			else if(complete && code == StartCodes::PictureStartCode)
+			{
+				entry.temporalReference = (header[0] << 2) | (header[1] >> 6);
+				entry.pictureType = (header[1] >> 3) & 0x7;
+			}
+			else if(complete && code == StartCodes::SequenceHeaderCode)
+			{
+				entry.pictureRate = header[3] & 0xf;
+				entry.bitRate = (header[4] << 10) | (header[5] << 2) | (header[6] >> 6);
+			}
+
+			entries.append(entry);
+
+			i = position + 4;
+		}
+
+		if(last)
+			return length;
+
+		return qMax(i, 0);
+	}
+}
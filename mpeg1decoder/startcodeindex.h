@@ -0,0 +1,152 @@
+#if !defined(MPEG1_STARTCODEINDEX_H)
+#define MPEG1_STARTCODEINDEX_H
+
+#include <QtCore/QIODevice>
+#include <QtCore/QVector>
+
+namespace Mpeg1
+{
+	/// An ordered list of the sequence, group of pictures and picture start codes of a stream.
+	///
+	/// The index is built by scanning the raw bytes for the 0x000001 prefix without decoding anything,
+	/// and keeps just enough of the header following each start code (closed GOP flag, time code,
+	/// picture type) to decide where decoding can start and how far it has to go.
+	///
+	/// Slice start codes are left out on purpose. Encoders commonly start a slice on every
+	/// macroblock row, so they would make up nearly all of the entries. Seeking, segmenting and counting
+	/// frames only need groups and pictures, and the decoder finds the slices of a picture itself
+	/// (see InputBitstream::skipToNextStartCode()). User data and extension start codes are left
+	/// out as well.
+	class StartCodeIndex
+	{
+	public:
+		/// A single start code found in the stream
+		struct Entry
+		{
+			qint64 offset;				//< Byte offset of the first byte of the start code
+			int code;					//< The 32-bit start code
+
+			// Group of pictures header only
+			int timeCode;				//< The 25-bit time code
+			bool closedGop;
+			bool brokenLink;
+
+			// Picture header only
+			int temporalReference;
+			int pictureType;			//< See VideoPicture::PictureCoding
+
+			// Sequence header only
+			int pictureRate;			//< The picture_rate code
+			int bitRate;				//< The bit_rate, in units of 400 bits per second
+		};
+
+		/// A group of pictures of the stream, with its pictures numbered in display order.
+		///
+		/// Frames are numbered from the start of the stream as a Decoder outputs them when decoding the
+		/// whole stream. The leading B pictures of an open first group predict from nothing and are
+		/// never output, so the frame numbers of that group start below 0.
+		struct Group
+		{
+			int entry;					//< Index entry of the group start code
+			qint64 end;					//< Byte offset where the pictures of the group end
+			int firstFrame;				//< Frame number of the picture with temporal reference 0
+			int frameCount;				//< Number of pictures in the group
+			int leadingFrames;			//< B pictures displayed before the I picture, predicted from the group before
+			bool closed;
+		};
+
+		/// Base constructor. Creates an empty index
+		StartCodeIndex();
+
+		/// Scans the whole device and replaces the contents of the index.
+		///
+		/// The device must be random access. Its position is restored when the scan completes.
+		///
+		/// A single thread scanning with memchr() falls well short of what a fast disk delivers. With
+		/// an executor, a large file is split into chunks which are read through their own QFile and
+		/// scanned on the workers at the same time. Each chunk is read a few bytes past its end so
+		/// the header of a start code beginning at its very end is complete, and the entries of the
+		/// chunks are then appended in order. Other devices are scanned on the calling thread.
+		///
+		/// \param device the stream to index
+		/// \param executor runs the chunk scans of a file, or 0 to scan on the calling thread
+		/// \return true on success, false if the device could not be read.
+		bool build(QIODevice *device, class Executor *executor = 0);
+
+		/// Empties the index
+		void clear();
+
+		/// Returns the number of entries in the index
+		int count() const;
+
+		/// Returns the entry at the given position in stream order
+		const Entry &at(int index) const;
+
+		/// Returns all of the entries in stream order
+		const QVector<Entry> &entries() const;
+
+		/// Returns the size in bytes of the stream which was indexed
+		qint64 streamSize() const;
+
+		/// Returns the byte offset at which the given entry ends, which is where the next entry starts
+		/// or the end of the stream for the last entry.
+		qint64 endOffset(int index) const;
+
+		/// Returns the position of the sequence header in effect for the given entry, or -1 if no
+		/// sequence header precedes it.
+		int sequenceHeaderFor(int index) const;
+
+		/// Returns the groups of pictures of the stream in stream order
+		const QVector<Group> &groups() const;
+
+		/// Returns the position in groups() of the group holding a frame, or -1 if no group does
+		int findGroup(int frame) const;
+
+		/// Returns the number of frames a Decoder outputs for the whole stream
+		int frameCount() const;
+
+		/// Reads a device from any byte offset up to the first group of pictures start code after it
+		/// and the picture start code following that, to resynchronize without indexing the stream.
+		///
+		/// \param device the stream, which must be random access. Its position is left after the bytes read.
+		/// \param offset the byte offset to start from, which needn't be on a start code
+		/// \param maximumLength the number of bytes to read at most
+		/// \param entries receives the entries found from offset on
+		/// \return the position in entries of the group start code, or -1 if there is none within
+		///         maximumLength bytes or the device could not be read
+		static int scanToGroup(QIODevice *device, qint64 offset, qint64 maximumLength, QVector<Entry> &entries);
+
+		/// Scans the bytes of a device from begin to end, and appends an entry for each start code of
+		/// interest beginning in that range.
+		///
+		/// \param device the stream, which must be random access. Its position is left after the bytes read.
+		/// \return false if the device could not be read
+		static bool scanRange(QIODevice *device, qint64 begin, qint64 end, QVector<Entry> &entries);
+
+	protected:
+		/// Scans a buffer for start codes and appends an entry for each one of interest.
+		///
+		/// Start codes too close to the end of the buffer for their header to be read are left for the
+		/// next call unless this is the last buffer of the stream.
+		///
+		/// \param data the bytes to scan
+		/// \param length the number of bytes in data
+		/// \param offset the position of data[0] within the stream
+		/// \param last true if data reaches the end of the stream
+		/// \param entries the list to append entries to
+		/// \return the number of bytes consumed. The rest must be presented again with the next buffer.
+		static int scan(const uchar *data, int length, qint64 offset, bool last, QVector<Entry> &entries);
+
+	private:
+		bool buildParallel(const QString &fileName, qint64 size, class Executor *executor);
+
+		void buildGroups();
+
+	private:
+		QVector<Entry> m_entries;
+		QVector<Group> m_groups;
+		qint64 m_streamSize;
+	};
+}
+
+#endif
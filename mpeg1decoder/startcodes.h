@@ -0,0 +1,33 @@
+#if !defined(MPEG1_STARTCODES_H)
+#define MPEG1_STARTCODES_H
+
+namespace Mpeg1
+{
+	/// Start codes are reserved bit patterns that do not otherwise
+	/// occur in the video stream. All start codes are byte aligned.
+	///
+	/// These are shared between the sequence level parser in Decoder and the
+	/// slice level parser in PictureDecoder which may run on a different thread.
+	namespace StartCodes
+	{
+		static const int StartCode = 0x000001;		// 24-bit code
+
+		static const int PictureStartCode = 0x00000100;
+		static const int SliceStartCode = 0x00000101;	// through 0x000001af
+		static const int LastSliceStartCode = 0x000001af;
+
+		static const int UserDataStartCode = 0x000001b2;
+		static const int SequenceHeaderCode = 0x000001b3;
+		static const int ExtensionStartCode = 0x000001b5;
+		static const int SequenceEndCode = 0x000001b7;
+		static const int GroupStartCode = 0x000001b8;
+
+		/// Returns true if the 32-bit code is one of the slice start codes
+		inline bool isSliceStartCode(int code)
+		{
+			return code >= SliceStartCode && code <= LastSliceStartCode;
+		}
+	}
+}
+
+#endif
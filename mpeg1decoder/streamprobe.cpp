@@ -0,0 +1,141 @@
+#include "streamprobe.h"
+#include "grouplocator.h"
+#include "inputbitstream.h"
+#include "startcodes.h"
+
+#include "utility.h"
+
+#include <QtCore/QBuffer>
+
+namespace Mpeg1
+{
+	// A sequence header with both quantizer matrices
+	static const int MaximumSequenceHeaderLength = 4 + 8 + 64 + 64;
+
+	bool StreamProbe::probe(QIODevice *device, Info &info, qint64 maximumLength)
+	{
+		qint64 position = device->pos();
+
+		info.streamSize = device->size();
+
+		QVector<StartCodeIndex::Entry> head;
+		bool result = StartCodeIndex::scanRange(device, 0, qMin(maximumLength, info.streamSize), head);
+
+		int sequenceHeader = -1;
+		for(int i = 0; result && sequenceHeader < 0 && i < head.count(); i++)
+		{
+			if(head.at(i).code == StartCodes::SequenceHeaderCode)
+				sequenceHeader = i;
+		}
+
+		result = sequenceHeader >= 0 && readSequenceHeader(device, head.at(sequenceHeader).offset, info);
+		if(result)
+			estimateLength(device, head, maximumLength, info);
+
+		device->seek(position);
+		return result;
+	}
+
+	/// Parses the sequence header at an offset as Decoder::parseSequenceHeader() does
+	bool StreamProbe::readSequenceHeader(QIODevice *device, qint64 offset, Info &info)
+	{
+		if(!device->seek(offset))
+			return false;
+
+		QByteArray data = device->read(MaximumSequenceHeaderLength);
+		if(data.size() < 12)
+			return false;
+
+		QBuffer buffer(&data);
+		buffer.open(QIODevice::ReadOnly);
+		InputBitstream input(&buffer);
+
+		input.skipBits(32);		// sequenceHeaderCode
+
+		info.width = input.getBits(12);
+		info.height = input.getBits(12);
+		info.pelAspectRatio = input.getBits(4);
+		info.pictureRate = input.getBits(4);
+		info.bitRate = input.getBits(18);
+
+		input.skipBits(1);		// Marker bit
+
+		info.vbvBufferSize = input.getBits(10);
+		info.constrainedParameters = input.getBool();
+
+		info.loadIntraQuantizerMatrix = input.getBool();
+		if(info.loadIntraQuantizerMatrix)
+		{
+			for(int i = 0; i < 64; i++)
+				input.skipBits(8);
+		}
+
+		info.loadNonIntraQuantizerMatrix = input.getBool();
+
+		info.picturesPerSecond = picturesPerSecond(info.pictureRate);
+		return true;
+	}
+
+	/// Counts or estimates the frames of the stream from the entries of its first bytes and a read
+	/// of its last bytes
+	void StreamProbe::estimateLength(QIODevice *device, const QVector<StartCodeIndex::Entry> &head, qint64 maximumLength, Info &info)
+	{
+		int pictures = 0;
+		int firstGroup = -1;
+		qint64 firstPicture = -1;
+		qint64 lastPicture = -1;
+
+		for(int i = 0; i < head.count(); i++)
+		{
+			const StartCodeIndex::Entry &entry = head.at(i);
+
+			if(entry.code == StartCodes::GroupStartCode && firstGroup < 0)
+				firstGroup = i;
+			else if(entry.code == StartCodes::PictureStartCode)
+			{
+				if(firstPicture < 0)
+					firstPicture = entry.offset;
+				lastPicture = entry.offset;
+				pictures++;
+			}
+		}
+
+		info.frameCount = pictures;
+		info.frameCountExact = maximumLength >= info.streamSize;
+
+		if(!info.frameCountExact)
+		{
+			// The frames up to the last group of pictures by their time codes, and those after it
+			QVector<StartCodeIndex::Entry> tail;
+			qint64 tailBegin = qMax(maximumLength, info.streamSize - maximumLength);
+
+			int lastGroup = -1;
+			int picturesAfter = 0;
+			if(firstGroup >= 0 && StartCodeIndex::scanRange(device, tailBegin, info.streamSize, tail))
+			{
+				for(int i = 0; i < tail.count(); i++)
+				{
+					if(tail.at(i).code == StartCodes::GroupStartCode)
+					{
+						lastGroup = i;
+						picturesAfter = 0;
+					}
+					else if(tail.at(i).code == StartCodes::PictureStartCode)
+						picturesAfter++;
+				}
+			}
+
+			int frames = 0;
+			if(lastGroup >= 0)
+				frames = GroupLocator::timeCodeFrame(tail.at(lastGroup).timeCode, info.pictureRate) - GroupLocator::timeCodeFrame(head.at(firstGroup).timeCode, info.pictureRate) + picturesAfter;
+
+			// Without usable time codes, the pictures at the start are taken as typical of the stream
+			if(frames > pictures)
+				info.frameCount = frames;
+			else if(pictures > 1 && lastPicture > firstPicture)
+				info.frameCount = (int)((info.streamSize - firstPicture) * (pictures - 1) / (lastPicture - firstPicture));
+		}
+
+		info.duration = info.picturesPerSecond > 0 ? info.frameCount / info.picturesPerSecond : 0;
+	}
+}
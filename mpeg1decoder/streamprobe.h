@@ -0,0 +1,57 @@
+#if !defined(MPEG1_STREAMPROBE_H)
+#define MPEG1_STREAMPROBE_H
+
+#include <QtCore/QIODevice>
+
+#include "startcodeindex.h"
+
+namespace Mpeg1
+{
+	/// Reads the parameters of a stream and estimates its length without decoding anything, to show
+	/// information about a file or to size resources before a Decoder is set up.
+	///
+	/// Only the start and the end of the stream are read. The parameters come from the first
+	/// sequence header. The number of frames is counted when the whole stream fits in what is read,
+	/// and otherwise taken from the time codes of the first and the last group of pictures found,
+	/// or failing that estimated from the bytes per picture at the start of the stream.
+	class StreamProbe
+	{
+	public:
+		/// The parameters of a stream. See ISO/IEC 11172-2 2.4.3.2
+		struct Info
+		{
+			int width;
+			int height;
+			int pelAspectRatio;			//< The pel_aspect_ratio code
+			int pictureRate;			//< The picture_rate code
+			int bitRate;				//< In units of 400 bits per second, 0x3ffff for a variable bit rate
+			int vbvBufferSize;			//< In units of 16384 bits
+			bool constrainedParameters;
+			bool loadIntraQuantizerMatrix;
+			bool loadNonIntraQuantizerMatrix;
+
+			qreal picturesPerSecond;
+
+			qint64 streamSize;			//< In bytes
+			int frameCount;
+			bool frameCountExact;		//< true if every picture was counted rather than estimated
+			qreal duration;				//< In seconds
+		};
+
+		/// Probes a stream
+		///
+		/// \param device the stream, which must be random access. Its position is restored.
+		/// \param info receives the parameters of the stream
+		/// \param maximumLength the number of bytes read at most from each of the start and the end
+		///                      of the stream
+		/// \return false if no sequence header was found at the start of the stream
+		static bool probe(QIODevice *device, Info &info, qint64 maximumLength = 1 << 16);
+
+	private:
+		static bool readSequenceHeader(QIODevice *device, qint64 offset, Info &info);
+
+		static void estimateLength(QIODevice *device, const QVector<StartCodeIndex::Entry> &head, qint64 maximumLength, Info &info);
+	};
+}
+
+#endif
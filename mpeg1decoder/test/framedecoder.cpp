@@ -0,0 +1,169 @@
+#include "framedecoder.h"
+
+#include "../decoder.h"
+#include "../executor.h"
+#include "../inputbitstream.h"
+#include "../videobuffer.h"
+#include "../videopicture.h"
+#include "../videorenderer.h"
+
+#include <QtCore/QBuffer>
+#include <QtGui/QImage>
+
+/// Receives the pictures of one decodeFrame() call as numbered images.
+///
+/// Each picture is numbered from the first frame of its group and its temporal reference, so the
+/// pictures the decoder drops don't shift the numbers of the others. Temporal references count up
+/// in display order within a group, and start again at the next group.
+class FrameRenderer : public Mpeg1::VideoRenderer
+{
+public:
+  FrameRenderer(const QList<int> &groupFirstFrames) :
+    m_groupFirstFrames(groupFirstFrames),
+    m_group(0),
+    m_lastTemporalReference(-1),
+    m_frame(0)
+  {
+  }
+
+  void setSize(int width, int height)
+  {
+    m_size = QSize(width, height);
+  }
+
+  void pushPicture(const Mpeg1::VideoPicture *, int)
+  {
+  }
+
+  bool acquireBuffer(const Mpeg1::VideoPicture *picture, int, Mpeg1::VideoBuffer &buffer)
+  {
+    int temporalReference = picture->temporalReference();
+    if(temporalReference <= m_lastTemporalReference && m_group + 1 < m_groupFirstFrames.count())
+      m_group++;
+
+    m_lastTemporalReference = temporalReference;
+    m_frame = m_groupFirstFrames.at(m_group) + temporalReference;
+
+    QImage *image = new QImage(m_size, QImage::Format_RGB32);
+
+    buffer.format = Mpeg1::VideoBuffer::FormatRgb32;
+    buffer.data[0] = image->bits();
+    buffer.stride[0] = image->bytesPerLine();
+    buffer.context = image;
+    return true;
+  }
+
+  void pushBuffer(const Mpeg1::VideoBuffer &buffer, int type)
+  {
+    FrameDecoder::Frame frame;
+    frame.number = m_frame;
+    frame.type = type;
+    frame.image = (QImage *) buffer.context;
+
+    m_frames.append(frame);
+  }
+
+  const QList<FrameDecoder::Frame> &frames() const
+  {
+    return m_frames;
+  }
+
+private:
+  QSize m_size;
+  QList<int> m_groupFirstFrames;
+  int m_group;
+  int m_lastTemporalReference;
+  int m_frame; // The number of the picture between acquireBuffer() and pushBuffer()
+  QList<FrameDecoder::Frame> m_frames;
+};
+
+FrameDecoder::FrameDecoder() :
+  m_indexed(false)
+{
+}
+
+FrameDecoder::~FrameDecoder()
+{
+  close();
+}
+
+bool FrameDecoder::open(const QString &fileName)
+{
+  close();
+
+  m_file.setFileName(fileName);
+  return m_file.open(QIODevice::ReadOnly);
+}
+
+void FrameDecoder::close()
+{
+  m_file.close();
+  m_index.clear();
+  m_indexed = false;
+}
+
+QList<FrameDecoder::Frame> FrameDecoder::decodeFrame(int number)
+{
+  if(!m_indexed && !buildIndex())
+    return QList<Frame>();
+
+  const QVector<Mpeg1::StartCodeIndex::Group> &groups = m_index.groups();
+
+  int target = m_index.findGroup(number);
+  if(number < 0 || target < 0)
+    return QList<Frame>();
+
+  // The leading B pictures of an open group need the last anchor of the group before
+  int first = target;
+  const Mpeg1::StartCodeIndex::Group &group = groups.at(target);
+  if(!group.closed && target > 0 && number < group.firstFrame + group.leadingFrames)
+    first = target - 1;
+
+  const Mpeg1::StartCodeIndex::Group &start = groups.at(first);
+  int sequenceHeader = m_index.sequenceHeaderFor(start.entry);
+  if(sequenceHeader < 0)
+    return QList<Frame>();
+
+  // Make the groups look like a complete stream to the decoder, as BatchDecoder does
+  qint64 headerBegin = m_index.at(sequenceHeader).offset;
+  qint64 headerEnd = m_index.endOffset(sequenceHeader);
+  qint64 begin = m_index.at(start.entry).offset;
+
+  QByteArray data;
+  m_file.seek(headerBegin);
+  data.append(m_file.read(headerEnd - headerBegin));
+  m_file.seek(begin);
+  data.append(m_file.read(group.end - begin));
+
+  static const char sequenceEndCode[] = { 0x00, 0x00, 0x01, (char) 0xb7 };
+  data.append(sequenceEndCode, sizeof(sequenceEndCode));
+
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+  Mpeg1::InputBitstream input(&buffer);
+
+  QList<int> groupFirstFrames;
+  groupFirstFrames.append(start.firstFrame);
+  if(first != target)
+    groupFirstFrames.append(group.firstFrame);
+
+  FrameRenderer renderer(groupFirstFrames);
+
+  Mpeg1::Decoder decoder(0, &input, &renderer);
+  decoder.setExecutor(Mpeg1::Executor::globalInstance());
+  decoder.start();
+
+  return renderer.frames();
+}
+
+bool FrameDecoder::buildIndex()
+{
+  if(m_indexed)
+    return true;
+
+  if(!m_index.build(&m_file, Mpeg1::Executor::globalInstance()))
+    return false;
+
+  m_indexed = true;
+  return true;
+}
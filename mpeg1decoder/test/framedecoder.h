@@ -0,0 +1,55 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QtCore/QFile>
+#include <QtCore/QList>
+
+#include "../startcodeindex.h"
+
+class QImage;
+
+/// Decodes any frame of a file on demand, by decoding the group of pictures it belongs to.
+///
+/// Frames are numbered in display order from the start of the file, as the Decoder outputs them
+/// when playing the whole file. The file is indexed by buildIndex(), or the first time a frame is
+/// asked for.
+class FrameDecoder
+{
+public:
+  /// A frame produced by decodeFrame()
+  struct Frame
+  {
+    int number;
+    int type;
+    QImage *image;
+  };
+
+  FrameDecoder();
+
+  ~FrameDecoder();
+
+  bool open(const QString &fileName);
+
+  void close();
+
+  /// Decodes the group of pictures holding a frame.
+  ///
+  /// Every frame of the group is returned, so stepping through the neighbouring frames does not
+  /// need decoding again. Decoding starts at the group before when the frame is one of the leading
+  /// B pictures of an open group, and the frames of that group are returned as well.
+  ///
+  /// \param number the frame number
+  /// \return the frames in display order, whose images are owned by the caller. Empty if the frame
+  ///         is not in the file.
+  QList<Frame> decodeFrame(int number);
+
+  /// Indexes the file, which reads the whole of it. Does nothing once the file is indexed.
+  bool buildIndex();
+
+private:
+  QFile m_file;
+  bool m_indexed;
+  Mpeg1::StartCodeIndex m_index;
+};
+
+#endif // FRAMEDECODER_H
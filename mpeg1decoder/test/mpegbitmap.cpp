@@ -1,56 +1,37 @@
 #include "mpegbitmap.h"
 
+#include "../colorconverter.h"
 #include "../videopicture.h"
-#include "../utility.h"
 #include <QtGui/QImage>
 #include <QtCore/QDebug>
+#include <QtCore/QVector>
 
 MpegBitmap::MpegBitmap()
 {
 }
 
-inline QRgb MpegBitmap::colorConvert(int luma, int chromaRed1, int chromaBlue1, int chromaRed2, int chromaBlue2)
+/// Converts a decoded picture to a 32 bit image, reusing the image if it already has the right size
+void MpegBitmap::mpegToQImage(const QSize &sourceSize, const Mpeg1::VideoPicture *source, class QImage &out)
 {
-	return qRgb(luma, luma, luma);
-	luma <<= 16;
-	int red = clip255((luma + chromaRed1) >> 16);
-	int green = clip255((luma - chromaBlue1 - chromaRed2) >> 16);
-	int blue = clip255((luma + chromaBlue2) >> 16);
+	if(out.size() != sourceSize)
+		out = QImage(sourceSize, QImage::Format_RGB32);
 
-	return qRgb(red, green, blue);
+	Mpeg1::ColorConverter::convert(*source, sourceSize, out.bits(), out.bytesPerLine(), Mpeg1::ColorConverter::FormatRgb32);
 }
 
-void MpegBitmap::mpegToQImage(const QSize &sourceSize, const Mpeg1::VideoPicture *source, class QImage &out)
+/// Converts a decoded picture to thumbnails or previews in a single pass, without converting the
+/// picture at full size first. Each image keeps the size it already has, and must not be null.
+void MpegBitmap::mpegToScaledQImages(const QSize &sourceSize, const Mpeg1::VideoPicture *source, class QImage *out, int count, Mpeg1::ColorConverter::ScaleFilter filter)
 {
-	if(out.size() != sourceSize)
-		out = QImage(sourceSize, QImage::Format_ARGB32);
+	QVector<Mpeg1::ColorConverter::ScaledOutput> outputs;
 
-	for(int y=0; y<(sourceSize.height() >> 1); y++)
+	for(int i = 0; i < count; i++)
 	{
-		const qreal *cbIn = source->chromaBlue().scanLine(y);
-		const qreal *crIn = source->chromaRed().scanLine(y);
-		const qreal *lumaInTop = source->luma().scanLine(y << 1);
-		const qreal *lumaInBottom = source->luma().scanLine((y << 1) + 1);
-
-		QRgb *outTop = (QRgb *) out.scanLine(y << 1);
-		QRgb *outBottom = (QRgb *) out.scanLine((y << 1) + 1);
-
-		for(int x=0; x<(sourceSize.width() >> 1); x++)
-		{
-			int chromaBlue = (int)*cbIn++;
-			chromaBlue -= 128;
-			int chromaRed = (int)*crIn++;
-			chromaRed -= 128;
-
-			int c1cr = C1 * chromaRed;
-			int c2cb = C2 * chromaBlue;
-			int c3cr = C3 * chromaRed;
-			int c4cb = C4 * chromaBlue;
-
-			*outTop++ = colorConvert((int) *lumaInTop++, c1cr, c2cb, c3cr, c4cb);
-			*outTop++ = colorConvert((int) *lumaInTop++, c1cr, c2cb, c3cr, c4cb);
-			*outBottom++ = colorConvert((int) *lumaInBottom++, c1cr, c2cb, c3cr, c4cb);
-			*outBottom++ = colorConvert((int) *lumaInBottom++, c1cr, c2cb, c3cr, c4cb);
-		}
+		if(out[i].format() != QImage::Format_RGB32)
+			out[i] = QImage(out[i].size(), QImage::Format_RGB32);
+
+		outputs.append(Mpeg1::ColorConverter::ScaledOutput(out[i].size(), out[i].bits(), out[i].bytesPerLine()));
 	}
+
+	Mpeg1::ColorConverter::convertScaled(*source, sourceSize, outputs.constData(), outputs.count(), filter);
 }
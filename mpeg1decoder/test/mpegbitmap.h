@@ -5,6 +5,8 @@
 #include <QtCore/QSize>
 #include <QtGui/QRgb>
 
+#include "../colorconverter.h"
+
 namespace Mpeg1
 {
   class VideoPicture;
@@ -12,19 +14,12 @@ namespace Mpeg1
 
 class MpegBitmap
 {
-private:
-    static const int C1 = 0x166E9;  // 1.402 * 2^16
-    static const int C2 = 0x5819;   // 0.34414 * 2^16
-    static const int C3 = 0xB6D1;   // 0.71414 * 2^16
-    static const int C4 = 0x1C5A1;  // 1.772 * 2^16
-
 public:
     MpegBitmap();
 
     static void mpegToQImage(const QSize &sourceSize, const Mpeg1::VideoPicture *source, class QImage &out);
 
-private:
-    static QRgb colorConvert(int luma, int chromaRed1, int chromaBlue1, int chromaRed2, int chromaBlue2);
+    static void mpegToScaledQImages(const QSize &sourceSize, const Mpeg1::VideoPicture *source, class QImage *out, int count, Mpeg1::ColorConverter::ScaleFilter filter = Mpeg1::ColorConverter::FilterBox);
 };
 
 #endif // MPEGBITMAP_H
@@ -3,13 +3,17 @@
 
 #include "mpegviewer.h"
 
-#include "../picturequeue.h"
+#include "../conversionstage.h"
 #include "../decoder.h"
+#include "../executor.h"
+#include "../videobuffer.h"
+#include "../videopicture.h"
 #include "../videorenderer.h"
 #include "../inputbitstream.h"
-#include "mpegbitmap.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
 #include <QtGui/QKeyEvent>
 #include <QtGui/QApplication>
 #include <QtGui/QPainter>
@@ -27,52 +31,346 @@ public:
     m_parent->setPictureSize(QSize(width, height));
   }
 
-  void pushPicture(const Mpeg1::VideoPicture *picture, int type)
+  /// Only reached when playback was stopped and the viewer declined a buffer
+  void pushPicture(const Mpeg1::VideoPicture *, int)
   {
-	  m_parent->pushPicture(picture, type);
+  }
+
+  bool acquireBuffer(const Mpeg1::VideoPicture *, int, Mpeg1::VideoBuffer &buffer)
+  {
+    return m_parent->acquireBuffer(buffer);
+  }
+
+  void pushBuffer(const Mpeg1::VideoBuffer &buffer, int type)
+  {
+    m_parent->pushBuffer(buffer, type);
+  }
+
+  void setPictureRate(int pictureRate)
+  {
+    m_parent->setPictureRate(pictureRate);
   }
 
 private:
   MpegViewer *m_parent;
 };
 
+/// Runs the decoder, which sends its pictures to the viewer through the conversion stage
+class DecoderThread : public QThread
+{
+public:
+  DecoderThread(Mpeg1::Decoder *decoder, Mpeg1::ConversionStage *conversionStage) :
+    m_decoder(decoder),
+    m_conversionStage(conversionStage)
+  {
+  }
+
+protected:
+  void run()
+  {
+    m_decoder->start();
+    m_conversionStage->waitForDone();
+  }
+
+private:
+  Mpeg1::Decoder *m_decoder;
+  Mpeg1::ConversionStage *m_conversionStage;
+};
+
+/// Indexes the file and decodes again the frames which have left the cache, so that neither reading
+/// the whole file nor decoding a group of pictures happens on the GUI thread
+class FrameThread : public QThread
+{
+public:
+  FrameThread(MpegViewer *viewer, FrameDecoder *frameDecoder) :
+    m_viewer(viewer),
+    m_frameDecoder(frameDecoder),
+    m_request(-1),
+    m_stopped(false)
+  {
+  }
+
+  /// Asks for the group of pictures holding a frame. Replaces a request which hasn't started yet.
+  void request(int frame)
+  {
+    QMutexLocker locker(&m_mutex);
+    m_request = frame;
+    m_changed.wakeAll();
+  }
+
+  /// Returns once the frame being decoded, if any, is done
+  void stop()
+  {
+    {
+      QMutexLocker locker(&m_mutex);
+      m_stopped = true;
+      m_changed.wakeAll();
+    }
+
+    wait();
+  }
+
+protected:
+  void run()
+  {
+    m_frameDecoder->buildIndex();
+
+    for(;;)
+    {
+      int frame;
+      {
+        QMutexLocker locker(&m_mutex);
+        while(!m_stopped && m_request < 0)
+          m_changed.wait(&m_mutex);
+
+        if(m_stopped)
+          return;
+
+        frame = m_request;
+        m_request = -1;
+      }
+
+      m_viewer->addDecodedFrames(m_frameDecoder->decodeFrame(frame));
+    }
+  }
+
+private:
+  MpegViewer *m_viewer;
+  FrameDecoder *m_frameDecoder;
+
+  QMutex m_mutex;
+  QWaitCondition m_changed;
+  int m_request;
+  bool m_stopped;
+};
+
 MpegViewer::MpegViewer(QWidget *parent) :
     QWidget(parent),
     m_decoder(0),
     m_inputStream(0),
-	m_imageIndex(0)
+    m_conversionStage(0),
+    m_decoderThread(0),
+    m_frameThread(0),
+    m_pictureRate(0),
+    m_queuedImages(0),
+    m_cancelled(false),
+    m_frameCache(FrameCacheSize),
+    m_requestedFrame(-1),
+    m_frameCount(0),
+	m_frameIndex(0)
 {
   setFocusPolicy(Qt::StrongFocus);
-  m_queue = new Mpeg1::PictureQueue;
   m_videoRenderer = new MpegVideoRenderer(this);
+
+  connect(&m_timer, SIGNAL(timeout()), this, SLOT(showNextPicture()));
 }
 
+MpegViewer::~MpegViewer()
+{
+  stop();
+  delete m_videoRenderer;
+}
+
+/// Decodes the file on a separate thread and plays the pictures as they arrive, so the first
+/// picture is shown as soon as it is decoded rather than once the whole file is.
+///
+/// Pictures are converted to RGB on the worker threads while the following ones are decoded,
+/// and the decoder and the conversion share the process wide executor.
 void MpegViewer::play(const QString &fileName)
 {
+  stop();
+
+  m_frameCache.clear();
+  m_frameCount = 0;
+  m_frameIndex = 0;
+
   m_file.setFileName(fileName);
   if(!m_file.open(QIODevice::ReadOnly))
     return;
 
+  // The file is indexed for stepping back while it plays
+  m_frameDecoder.open(fileName);
+  m_frameThread = new FrameThread(this, &m_frameDecoder);
+  m_frameThread->start();
+
+  m_conversionStage = new Mpeg1::ConversionStage(m_videoRenderer, Mpeg1::Executor::globalInstance());
   m_inputStream = new Mpeg1::InputBitstream(&m_file);
-  m_decoder = new Mpeg1::Decoder(m_queue, m_inputStream, m_videoRenderer);
+  m_decoder = new Mpeg1::Decoder(0, m_inputStream, m_conversionStage);
+  m_decoder->setExecutor(Mpeg1::Executor::globalInstance());
+
+  m_decoderThread = new DecoderThread(m_decoder, m_conversionStage);
+  m_decoderThread->start();
+
+  m_timer.start(frameInterval(0));
+}
+
+void MpegViewer::stop()
+{
+  m_timer.stop();
+
+  if(m_frameThread)
+  {
+    m_frameThread->stop();
+    delete m_frameThread;
+    m_frameThread = 0;
+  }
+
+  // Frames of this file still on their way to the cache are dropped
+  {
+    QMutexLocker locker(&m_mutex);
+    for(int i = 0; i < m_decodedFrames.count(); i++)
+      delete m_decodedFrames.at(i).image;
+    m_decodedFrames.clear();
+  }
+  m_requestedFrame = -1;
+
+  if(!m_decoderThread)
+    return;
+
+  // Stop the decoder at its next step, and don't let it wait for images to be shown meanwhile
+  m_decoder->cancel();
+  {
+    QMutexLocker locker(&m_mutex);
+    m_cancelled = true;
+    m_imageTaken.wakeAll();
+  }
+
+  m_decoderThread->wait();
+
+  delete m_decoderThread;
+  delete m_decoder;
+  delete m_inputStream;
+  delete m_conversionStage;
+
+  m_decoderThread = 0;
+  m_decoder = 0;
+  m_inputStream = 0;
+  m_conversionStage = 0;
 
-  m_decoder->start();
-  update();
+  m_file.close();
+
+  while(!m_convertedImages.isEmpty())
+    delete m_convertedImages.dequeue().first;
+
+  m_queuedImages = 0;
+  m_cancelled = false;
+}
+
+/// Takes the next converted image. Called at the picture rate of the stream.
+void MpegViewer::showNextPicture()
+{
+  int interval = frameInterval(pictureRate());
+  if(m_timer.interval() != interval)
+    m_timer.setInterval(interval);
+
+  // Every image is queued by the time the thread has finished
+  bool finished = m_decoderThread->isFinished();
+
+  QPair<QImage *, int> converted;
+  {
+    QMutexLocker locker(&m_mutex);
+
+    if(m_convertedImages.isEmpty())
+    {
+      // Decoding is behind, try again on the next tick, unless it is over
+      if(finished)
+        m_timer.stop();
+      return;
+    }
+
+    converted = m_convertedImages.dequeue();
+    m_queuedImages--;
+    m_imageTaken.wakeAll();
+  }
+
+  // Follow the playback unless the user is stepping through the pictures already shown
+  bool following = m_frameIndex >= m_frameCount - 1;
+
+  addImage(converted.first, converted.second, m_frameCount++);
+
+  if(following)
+  {
+    m_frameIndex = m_frameCount - 1;
+    update();
+  }
 }
 
 void MpegViewer::setPictureSize(const QSize &pictureSize)
 {
+  QMutexLocker locker(&m_mutex);
   m_pictureSize = pictureSize;
   qDebug() << m_pictureSize;
 }
 
-void MpegViewer::pushPicture(const Mpeg1::VideoPicture *picture, int type)
+void MpegViewer::setPictureRate(int pictureRate)
+{
+  QMutexLocker locker(&m_mutex);
+  m_pictureRate = pictureRate;
+}
+
+QSize MpegViewer::pictureSize() const
+{
+  QMutexLocker locker(&m_mutex);
+  return m_pictureSize;
+}
+
+int MpegViewer::pictureRate() const
+{
+  QMutexLocker locker(&m_mutex);
+  return m_pictureRate;
+}
+
+/// Returns the time between two pictures in milliseconds for a picture_rate code of the sequence
+/// header. See ISO/IEC 11172-2 2.4.3.2
+int MpegViewer::frameInterval(int pictureRate)
+{
+  static const int intervals[] = { 40, 42, 42, 40, 33, 33, 20, 17, 17 };
+
+  if(pictureRate < 1 || pictureRate > 8)
+    return intervals[0];
+
+  return intervals[pictureRate];
+}
+
+/// Hands out a new image for the conversion stage to write the next picture into. Called on the
+/// decoding thread, which waits here while enough images are queued for display.
+bool MpegViewer::acquireBuffer(Mpeg1::VideoBuffer &buffer)
+{
+	QSize size = pictureSize();
+
+	{
+		QMutexLocker locker(&m_mutex);
+		while(!m_cancelled && m_queuedImages >= MaximumQueuedImages)
+			m_imageTaken.wait(&m_mutex);
+
+		if(m_cancelled)
+			return false;
+
+		m_queuedImages++;
+	}
+
+	QImage *image = new QImage(size, QImage::Format_RGB32);
+
+	buffer.format = Mpeg1::VideoBuffer::FormatRgb32;
+	buffer.data[0] = image->bits();
+	buffer.stride[0] = image->bytesPerLine();
+	buffer.context = image;
+	return true;
+}
+
+/// Queues a converted image for display. Called on a worker thread.
+void MpegViewer::pushBuffer(const Mpeg1::VideoBuffer &buffer, int type)
+{
+	QMutexLocker locker(&m_mutex);
+	m_convertedImages.enqueue(qMakePair((QImage *) buffer.context, type));
+}
+
+/// Labels a frame and keeps it in the cache, which takes ownership of the image
+void MpegViewer::addImage(QImage *newImage, int type, int frame)
 {	
-	const char *types[] = { "", "I", "P", "B" };
-	QImage *newImage = new QImage;
-	MpegBitmap::mpegToQImage(m_pictureSize, picture, *newImage);
+	const char *types[] = { "", "I", "P", "B", "D" };
 	QPainter p(newImage);
-	p.drawText(2, 12, QString("%1 %2").arg(types[type]).arg(m_imageList.count()));
+	p.drawText(2, 12, QString("%1 %2").arg(types[type]).arg(frame));
 
 	/*foreach(const Mpeg1::PictureMv *mv, picture->motionVectors())
 	{
@@ -84,20 +382,77 @@ void MpegViewer::pushPicture(const Mpeg1::VideoPicture *picture, int type)
 	}*/
 
 	p.end();
-	m_imageList.append(newImage);
+	m_frameCache.insert(frame, newImage, qMax(newImage->byteCount() / 1024, 1));
+}
+
+void MpegViewer::showFrame(int frame)
+{
+	m_frameIndex = frame;
+	update();
+}
+
+/// Returns a frame already played. When it has left the cache its group of pictures is decoded
+/// again on the frame thread, and 0 is returned until it arrives.
+QImage *MpegViewer::frameImage(int frame)
+{
+	if(frame >= m_frameCount)
+		return 0;
+
+	QImage *image = m_frameCache.object(frame);
+	if(!image && m_frameThread && m_requestedFrame != frame)
+	{
+		m_requestedFrame = frame;
+		m_frameThread->request(frame);
+	}
+
+	return image;
+}
+
+/// Hands the frames decoded again to the GUI thread. Called on the frame thread.
+void MpegViewer::addDecodedFrames(const QList<FrameDecoder::Frame> &frames)
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		m_decodedFrames += frames;
+	}
+
+	QMetaObject::invokeMethod(this, "takeDecodedFrames", Qt::QueuedConnection);
+}
+
+/// Caches the frames decoded again and shows the one waited for
+void MpegViewer::takeDecodedFrames()
+{
+	QList<FrameDecoder::Frame> frames;
+	{
+		QMutexLocker locker(&m_mutex);
+		frames = m_decodedFrames;
+		m_decodedFrames.clear();
+	}
+
+	if(frames.isEmpty())
+		return;
+
+	for(int i = 0; i < frames.count(); i++)
+		addImage(frames.at(i).image, frames.at(i).type, frames.at(i).number);
+
+	m_requestedFrame = -1;
+	update();
 }
 
 
 void MpegViewer::paintEvent(QPaintEvent *)
 {
-	if(m_imageIndex >= m_imageList.count())
+	QImage *image = frameImage(m_frameIndex);
+	if(!image)
 		return;
 
+	QSize size = pictureSize();
+
 	QPainter p(this);
-	//QRect r(0,0,m_pictureSize.width() * 8, m_pictureSize.height() * 8);
-	QRect r(0,0,m_pictureSize.width() * 4, m_pictureSize.height() * 4);
-	//QRect r(0,0,m_pictureSize.width(), m_pictureSize.height());
-	p.drawImage(r, *m_imageList[m_imageIndex]);
+	//QRect r(0,0,size.width() * 8, size.height() * 8);
+	QRect r(0,0,size.width() * 4, size.height() * 4);
+	//QRect r(0,0,size.width(), size.height());
+	p.drawImage(r, *image);
 	if(this->hasFocus())
 		p.drawRect(0,0,width()-1, height()-1);
 }
@@ -106,18 +461,12 @@ void MpegViewer::keyPressEvent(QKeyEvent *ev)
 {
 	if(ev->key() == Qt::Key_Right)
 	{
-		if(m_imageIndex < (m_imageList.count() - 1))
-		{
-			m_imageIndex++;
-			update();
-		}
+		if(m_frameIndex < (m_frameCount - 1))
+			showFrame(m_frameIndex + 1);
 	}
 	else if(ev->key() == Qt::Key_Left)
 	{
-		if(m_imageIndex > 0)
-		{
-			m_imageIndex--;
-			update();
-		}
+		if(m_frameIndex > 0)
+			showFrame(m_frameIndex - 1);
 	}
 }
@@ -1,16 +1,25 @@
 #ifndef MPEGVIEWER_H
 #define MPEGVIEWER_H
 
+#include <QtCore/QCache>
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QQueue>
 #include <QtCore/QSize>
+#include <QtCore/QTimer>
+#include <QtCore/QWaitCondition>
 #include <QtGui/QWidget>
 
+#include "framedecoder.h"
+
 namespace Mpeg1
 {
+  class ConversionStage;
   class Decoder;
   class InputBitstream;
-  class PictureQueue;
   class VideoPicture;
+  struct VideoBuffer;
 };
 
 class MpegViewer : public QWidget
@@ -18,17 +27,27 @@ class MpegViewer : public QWidget
     Q_OBJECT
 public:
     explicit MpegViewer(QWidget *parent = 0);
+    ~MpegViewer();
 
 signals:
 
 public slots:
   void play(const QString &fileName);
 
+private slots:
+  void showNextPicture();
+
+  void takeDecodedFrames();
+
 protected:
   friend class MpegVideoRenderer;
   void setPictureSize(const QSize &pictureSize);
 
-  void pushPicture(const Mpeg1::VideoPicture *picture, int type);
+  void setPictureRate(int pictureRate);
+
+  bool acquireBuffer(Mpeg1::VideoBuffer &buffer);
+
+  void pushBuffer(const Mpeg1::VideoBuffer &buffer, int type);
 
   void paintEvent(QPaintEvent *);
 
@@ -36,16 +55,62 @@ protected:
   virtual void keyPressEvent(QKeyEvent *ev);
 
 private:
+  void stop();
+
+  QSize pictureSize() const;
+
+  int pictureRate() const;
+
+  static int frameInterval(int pictureRate);
+
+  void addImage(class QImage *image, int type, int frame);
+
+  void showFrame(int frame);
+
+  class QImage *frameImage(int frame);
+
+  friend class FrameThread;
+  void addDecodedFrames(const QList<FrameDecoder::Frame> &frames);
+
+private:
+  // The number of images converted ahead of the display
+  static const int MaximumQueuedImages = 8;
+
+  // The memory used by the frames kept for stepping through, in kilobytes
+  static const int FrameCacheSize = 256 * 1024;
+
   Mpeg1::Decoder *m_decoder;
   Mpeg1::InputBitstream *m_inputStream;
-  Mpeg1::PictureQueue *m_queue;
+  Mpeg1::ConversionStage *m_conversionStage;
   class MpegVideoRenderer *m_videoRenderer;
+  class DecoderThread *m_decoderThread;
+  class FrameThread *m_frameThread;
   QFile m_file;
 
+  // Set from the decoding and conversion threads
+  mutable QMutex m_mutex;
   QSize m_pictureSize;
+  int m_pictureRate;
+
+  // Images converted but not shown yet, with their picture types, and the number of images
+  // handed out to the conversion stage which are either converting or queued
+  QQueue<QPair<QImage *, int> > m_convertedImages;
+  int m_queuedImages;
+  bool m_cancelled;
+  QWaitCondition m_imageTaken;
+
+  QTimer m_timer;
+
+  // The most recently used frames, by frame number. Frames which have been dropped are decoded again.
+  QCache<int, QImage> m_frameCache;
+  FrameDecoder m_frameDecoder;
+  int m_requestedFrame;
+
+  // Frames decoded again by the frame thread, waiting for the GUI thread to cache them
+  QList<FrameDecoder::Frame> m_decodedFrames;
 
-  QList<QImage *>m_imageList;
-  int m_imageIndex;
+  int m_frameCount;
+  int m_frameIndex;
 };
 
 #endif // MPEGVIEWER_H
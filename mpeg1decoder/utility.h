@@ -1,6 +1,8 @@
 #if !defined(MPEG1_UTILITY_H)
 #define MPEG1_UTILITY_H
 
+#include <QtCore/QtGlobal>
+
 static inline void copyShorts(const short *source, int sourceIndex, short *destination, int destinationIndex, int count)
 {
 	while(count--)
@@ -18,4 +20,13 @@ static inline int clip255(int v)
   return (v > 255) ? 255 : ((v < 0) ? 0 : v);
 }
 
+/// Returns the pictures per second of a picture_rate code of the sequence header, or 0 for a
+/// forbidden or reserved code. See ISO/IEC 11172-2 2.4.3.2
+static inline qreal picturesPerSecond(int pictureRate)
+{
+	static const qreal pictureRates[] = { 0, 24000 / 1001.0, 24, 25, 30000 / 1001.0, 30, 50, 60000 / 1001.0, 60 };
+
+	return (pictureRate > 0 && pictureRate < 9) ? pictureRates[pictureRate] : 0;
+}
+
 #endif
@@ -0,0 +1,88 @@
+#include "videobuffer.h"
+#include "colorconverter.h"
+#include "videopicture.h"
+
+#include "utility.h"
+
+namespace Mpeg1
+{
+	static inline uchar sample(qreal value)
+	{
+		return (uchar) clip255((int)(value + 0.5));
+	}
+
+	/// Rounds a line of samples to 8 bits, every step bytes apart
+	static inline void writeLine(const qreal *in, int count, uchar *out, int step)
+	{
+		for(int x = 0; x < count; x++, out += step)
+			*out = sample(in[x]);
+	}
+
+	VideoBuffer::VideoBuffer() :
+		format(FormatI420),
+		context(0)
+	{
+		for(int i = 0; i < 3; i++)
+		{
+			data[i] = 0;
+			stride[i] = 0;
+		}
+	}
+
+	void VideoBuffer::write(const VideoPicture &picture, const QSize &size, int firstLine, int lineCount) const
+	{
+		int width = qMin(size.width(), picture.luma().size().width());
+		int height = qMin(size.height(), picture.luma().size().height());
+
+		if(lineCount >= 0)
+			height = qMin(height, firstLine + lineCount);
+
+		firstLine &= ~1;
+
+		int chromaWidth = (width + 1) >> 1;
+		int chromaHeight = (height + 1) >> 1;
+		int chromaFirstLine = firstLine >> 1;
+
+		switch(format)
+		{
+		case FormatI420:
+			for(int y = firstLine; y < height; y++)
+				writeLine(picture.luma().scanLine(y), width, data[0] + y * stride[0], 1);
+
+			for(int y = chromaFirstLine; y < chromaHeight; y++)
+			{
+				writeLine(picture.chromaBlue().scanLine(y), chromaWidth, data[1] + y * stride[1], 1);
+				writeLine(picture.chromaRed().scanLine(y), chromaWidth, data[2] + y * stride[2], 1);
+			}
+			break;
+
+		case FormatNV12:
+			for(int y = firstLine; y < height; y++)
+				writeLine(picture.luma().scanLine(y), width, data[0] + y * stride[0], 1);
+
+			for(int y = chromaFirstLine; y < chromaHeight; y++)
+			{
+				uchar *out = data[1] + y * stride[1];
+				writeLine(picture.chromaBlue().scanLine(y), chromaWidth, out, 2);
+				writeLine(picture.chromaRed().scanLine(y), chromaWidth, out + 1, 2);
+			}
+			break;
+
+		case FormatYuy2:
+			// Each chroma line of the picture serves two lines of the buffer. A line is 2 * width bytes,
+			// so with an odd width the Cr of the last, half, pair has no room and is left out.
+			for(int y = firstLine; y < height; y++)
+			{
+				uchar *out = data[0] + y * stride[0];
+				writeLine(picture.luma().scanLine(y), width, out, 2);
+				writeLine(picture.chromaBlue().scanLine(y >> 1), chromaWidth, out + 1, 4);
+				writeLine(picture.chromaRed().scanLine(y >> 1), width >> 1, out + 3, 4);
+			}
+			break;
+
+		case FormatRgb32:
+			ColorConverter::convert(picture, QSize(width, height), data[0], stride[0], ColorConverter::FormatRgb32, firstLine);
+			break;
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#if !defined(MPEG1_VIDEOBUFFER_H)
+#define MPEG1_VIDEOBUFFER_H
+
+#include <QtCore/Qt>
+#include <QtCore/QSize>
+
+namespace Mpeg1
+{
+	/// Describes memory owned by a VideoRenderer which the decoder writes a picture into.
+	///
+	/// The decoder keeps its pictures as qreal planes, so every consumer has to convert them to
+	/// 8 bit samples at some point. Writing them straight into the consumer's memory (a texture, an
+	/// encoder input frame) saves it an extra copy of the whole frame.
+	struct VideoBuffer
+	{
+		enum Format
+		{
+			FormatI420,		//< Planar Y, Cb and Cr, chroma subsampled 2x2. Uses all three planes.
+			FormatNV12,		//< Planar Y followed by interleaved Cb Cr, chroma subsampled 2x2. Uses two planes.
+			FormatYuy2,		//< Packed Y0 Cb Y1 Cr, chroma subsampled 2x1. Uses one plane. Lines of an odd width end in Y Cb.
+			FormatRgb32		//< Packed 0xffRRGGBB words as QImage::Format_RGB32. Uses one plane.
+		};
+
+		VideoBuffer();
+
+		/// Writes a picture into the buffer, converting it to the format of the buffer
+		///
+		/// \param picture the fully reconstructed picture
+		/// \param size the size of the picture in pixels, as given by the sequence header
+		/// \param firstLine the first line to write, which must be even
+		/// \param lineCount the number of lines to write, or -1 for every line to the bottom
+		void write(const class VideoPicture &picture, const QSize &size, int firstLine = 0, int lineCount = -1) const;
+
+		Format format;
+		uchar *data[3];			//< The first sample of the top line of each plane
+		int stride[3];			//< The number of bytes from one line of each plane to the next
+		void *context;			//< Left to the renderer to identify the buffer when it is pushed back
+	};
+}
+
+#endif
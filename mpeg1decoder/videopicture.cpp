@@ -1,9 +1,17 @@
 #include "videopicture.h"
 #include "motionvector.h"
+#include "picturepool.h"
+
+#include <QtCore/QMutexLocker>
 
 namespace Mpeg1
 {
-	VideoPicture::VideoPicture()
+	VideoPicture::VideoPicture() :
+		m_temporalReference(0),
+		m_pictureType(PictureCodingI),
+		m_pool(0),
+		m_references(1),
+		m_decodedRows(0)
 	{
 	}
 
@@ -11,17 +19,30 @@ namespace Mpeg1
 	{
 	}
 
-	bool VideoPicture::allocate(const QSize &blocks, const QSize &lumaBlockSize, const QSize &chromaBlockSize)
+	bool VideoPicture::allocate(const QSize &blocks, const QSize &lumaBlockSize, const QSize &chromaBlockSize, bool lumaOnly)
 	{
 		if(!m_luma.allocate(blocks, lumaBlockSize))
 			return false;
 
+		if(lumaOnly)
+		{
+			if(!m_chromaBlue.allocateConstant(blocks, chromaBlockSize, 128.0))
+				return false;
+
+			return m_chromaRed.allocateConstant(blocks, chromaBlockSize, 128.0);
+		}
+
 		if(!m_chromaBlue.allocate(blocks, chromaBlockSize))
 			return false;
 
 		return m_chromaRed.allocate(blocks, chromaBlockSize);
 	}
 
+	bool VideoPicture::isLumaOnly() const
+	{
+		return m_chromaBlue.isConstant();
+	}
+
 	Plane &VideoPicture::luma()
 	{
 		return m_luma;
@@ -52,6 +73,22 @@ namespace Mpeg1
 		return m_chromaRed;
 	}
 
+	void VideoPicture::ref() const
+	{
+		m_references.ref();
+	}
+
+	void VideoPicture::release() const
+	{
+		if(m_references.deref())
+			return;
+
+		if(m_pool)
+			m_pool->recycle(const_cast<VideoPicture *>(this));
+		else
+			delete this;
+	}
+
 	int VideoPicture::temporalReference() const
 	{
 		return m_temporalReference;
@@ -75,21 +112,78 @@ namespace Mpeg1
 	void VideoPicture::copyMacroblock(const VideoPicture &source, quint32 macroblockAddress)
 	{
 		m_luma.copyBlock(source.m_luma, macroblockAddress);
+
+		if(isLumaOnly())
+			return;
+
 		m_chromaBlue.copyBlock(source.m_chromaBlue, macroblockAddress);
 		m_chromaRed.copyBlock(source.m_chromaRed, macroblockAddress);
 	}
 
-	void VideoPicture::compensate(const VideoPicture &source, quint32 macroblockAddress, const MotionVector &motionVector)
+	void VideoPicture::compensate(const VideoPicture &source, quint32 macroblockAddress, const QPoint &motion)
+	{
+		QPoint luma = scaleMotion(motion);
+		QPoint chroma = scaleMotion(QPoint(motion.x() >> 1, motion.y() >> 1));
+
+		m_luma.compensate(source.m_luma, macroblockAddress, MotionDescription(luma));
+
+		if(isLumaOnly())
+			return;
+
+		m_chromaBlue.compensate(source.m_chromaBlue, macroblockAddress, MotionDescription(chroma));
+		m_chromaRed.compensate(source.m_chromaRed, macroblockAddress, MotionDescription(chroma));
+	}
+
+	void VideoPicture::interpolate(const VideoPicture &source1, const QPoint &motion1, const VideoPicture &source2, const QPoint &motion2, quint32 macroblockAddress)
+	{
+		QPoint luma1 = scaleMotion(motion1);
+		QPoint luma2 = scaleMotion(motion2);
+		QPoint chroma1 = scaleMotion(QPoint(motion1.x() >> 1, motion1.y() >> 1));
+		QPoint chroma2 = scaleMotion(QPoint(motion2.x() >> 1, motion2.y() >> 1));
+
+		m_luma.interpolate(source1.m_luma, MotionDescription(luma1), source2.m_luma, MotionDescription(luma2), macroblockAddress);
+
+		if(isLumaOnly())
+			return;
+
+		m_chromaBlue.interpolate(source1.m_chromaBlue, MotionDescription(chroma1), source2.m_chromaBlue, MotionDescription(chroma2), macroblockAddress);
+		m_chromaRed.interpolate(source1.m_chromaRed, MotionDescription(chroma1), source2.m_chromaRed, MotionDescription(chroma2), macroblockAddress);
+	}
+
+	/// Scales a vector in half pel units of the full size picture to the size the picture is
+	/// decoded at, still in half pel units.
+	///
+	/// The vector is rounded down, which never reaches further out of the anchor than the full
+	/// size vector does, so a valid stream never reads outside of the planes.
+	QPoint VideoPicture::scaleMotion(const QPoint &motion) const
 	{
-		m_luma.compensate(source.m_luma, macroblockAddress, motionVector.luma());
-		m_chromaBlue.compensate(source.m_chromaBlue, macroblockAddress, motionVector.chroma());
-		m_chromaRed.compensate(source.m_chromaRed, macroblockAddress, motionVector.chroma());
+		int shift = 0;
+		while ((m_luma.blockSize().width() << shift) < 16)
+			shift++;
+
+		return QPoint(motion.x() >> shift, motion.y() >> shift);
 	}
 
-	void VideoPicture::interpolate(const VideoPicture &source1, const MotionVector &motionVector1, const VideoPicture &source2, const MotionVector &motionVector2, quint32 macroblockAddress)
+	int VideoPicture::decodedRows() const
 	{
-		m_luma.interpolate(source1.m_luma, motionVector1.luma(), source2.m_luma, motionVector2.luma(), macroblockAddress);
-		m_chromaBlue.interpolate(source1.m_chromaBlue, motionVector1.chroma(), source2.m_chromaBlue, motionVector2.chroma(), macroblockAddress);
-		m_chromaRed.interpolate(source1.m_chromaRed, motionVector1.chroma(), source2.m_chromaRed, motionVector2.chroma(), macroblockAddress);
+		return m_decodedRows.fetchAndAddAcquire(0);
+	}
+
+	void VideoPicture::setDecodedRows(int rows)
+	{
+		m_decodedRows.fetchAndStoreRelease(rows);
+
+		QMutexLocker locker(&m_decodedRowsMutex);
+		m_decodedRowsChanged.wakeAll();
+	}
+
+	void VideoPicture::waitForDecodedRows(int rows) const
+	{
+		if(decodedRows() >= rows)
+			return;
+
+		QMutexLocker locker(&m_decodedRowsMutex);
+		while(decodedRows() < rows)
+			m_decodedRowsChanged.wait(&m_decodedRowsMutex);
 	}
 }
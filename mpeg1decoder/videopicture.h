@@ -1,7 +1,11 @@
 #if !defined(VIDEOPICTURE_H)
 #define VIDEOPICTURE_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QPoint>
 #include <QtCore/QSize>
+#include <QtCore/QWaitCondition>
 #include "plane.h"
 
 namespace Mpeg1
@@ -38,8 +42,14 @@ namespace Mpeg1
 		/// \param blocks the number of blocks across and down for the picture.
 		/// \param lumaBlockSize the number of video samples (pixels) in a luma channel block. Generally 16.
 		/// \param chromaBlockSize the number of video samples (pixels) in a chroma channel block, Generally 8.
+		/// \param lumaOnly if true the chroma planes are constant planes of neutral samples (see
+		///                 Plane::allocateConstant()) which take a single line of memory each. They
+		///                 must not be written to and compensate() and interpolate() leave them alone.
 		/// \return true on success, false on failure. 
-		bool allocate(const QSize &blocks, const QSize &lumaBlockSize, const QSize &chromaBlockSize);
+		bool allocate(const QSize &blocks, const QSize &lumaBlockSize, const QSize &chromaBlockSize, bool lumaOnly = false);
+
+		/// Returns true if only the luma plane is decoded
+		bool isLumaOnly() const;
 
 		/// Returns a reference to the luma plane.
 		Plane &luma();
@@ -59,6 +69,18 @@ namespace Mpeg1
 		/// Returns a constant reference to the red chroma offset plane
 		const Plane &chromaRed() const;
 		
+		/// Adds a reference to the picture.
+		///
+		/// Pictures handed out by a PicturePool start with a single reference held by the caller. Any
+		/// other party (such as a worker thread reading the picture as an anchor) must add its own.
+		/// The reference count is not part of the picture contents so this works on constant pictures,
+		/// which lets a VideoRenderer keep a picture passed to pushPicture() past the call.
+		void ref() const;
+
+		/// Drops a reference to the picture. When the last reference is dropped the picture is
+		/// returned to the pool it came from, or deleted if it does not belong to a pool.
+		void release() const;
+
 		/// Returns the temporal reference of the picture as specified in the bitstream
 		int temporalReference() const;
 
@@ -87,25 +109,50 @@ namespace Mpeg1
 		///
 		/// \param source the source image to read from
 		/// \param macroblockAddress the macro block to be copied into and to use as the origin in the source
-		/// \param motionVector motion information for calculating the position of the source blocks in the source image
-		void compensate(const VideoPicture &source, quint32 macroblockAddress, const class MotionVector &motionVector);
+		/// \param motion the reconstructed luma motion vector in half pel units. The chroma vector is derived from it.
+		///               Both are scaled down when the picture is decoded at reduced size.
+		void compensate(const VideoPicture &source, quint32 macroblockAddress, const QPoint &motion);
 
 		/// Similar to compensate, but instead averages the values of two source blocks to calculate the new block.
 		///
 		/// \param source1 the first source image
-		/// \param motionVector1 the motion information for calculating the source block position
+		/// \param motion1 the luma motion vector in half pel units for calculating the source block position
 		/// \param source2 the second source image
-		/// \param motionVector2 the motion information for calculating the second source block position
+		/// \param motion2 the luma motion vector in half pel units for calculating the second source block position
 		/// \param macroblockAddress the address of the macro block to operate on.
-		void interpolate(const VideoPicture &source1, const class MotionVector &motionVector1, const VideoPicture &source2, const class MotionVector &motionVector2, quint32 macroblockAddress);
+		void interpolate(const VideoPicture &source1, const QPoint &motion1, const VideoPicture &source2, const QPoint &motion2, quint32 macroblockAddress);
+
+		/// Returns the number of macroblock rows, counting from the top, which are fully reconstructed.
+		int decodedRows() const;
+
+		/// Called by the reconstruction stage to report progress and wake any thread waiting on it.
+		void setDecodedRows(int rows);
+
+		/// Blocks until at least the given number of macroblock rows are fully reconstructed.
+		///
+		/// Pictures are reconstructed on a different thread than the one parsing them, so anything
+		/// reading a picture (prediction from an anchor, output to a renderer) must wait on this first.
+		void waitForDecodedRows(int rows) const;
+
+	private:
+		QPoint scaleMotion(const QPoint &motion) const;
 
 	private:
+		friend class PicturePool;
+
 		Plane m_luma;
 		Plane m_chromaBlue;
 		Plane m_chromaRed;
 
 		int m_temporalReference;
 		PictureCoding m_pictureType;
+
+		class PicturePool *m_pool;
+		mutable QAtomicInt m_references;
+
+		mutable QAtomicInt m_decodedRows;
+		mutable QMutex m_decodedRowsMutex;
+		mutable QWaitCondition m_decodedRowsChanged;
 	};
 }
 
@@ -1,15 +1,35 @@
 #if !defined(MPEG1_VIDEORENDERER_H)
 #define MPEG1_VIDEORENDERER_H
 
+#include "videobuffer.h"
+
 namespace Mpeg1
 {
 	class VideoRenderer
 	{
 	public:
+		virtual ~VideoRenderer() {}
+
 		virtual void setSize(int width, int height) = 0;
 
 		virtual void pushPicture(const VideoPicture *picture, int type) = 0;
 
+		/// Asks the renderer for memory to write the next picture into.
+		///
+		/// Called for each picture, in display order, before it is output. When the renderer fills in
+		/// the buffer and returns true, the decoder writes the picture into it in the requested format
+		/// and passes it back through pushBuffer() instead of calling pushPicture(). Renderers which
+		/// read the pictures themselves keep the default, which declines.
+		///
+		/// \param picture the picture about to be output
+		/// \param type the picture coding type
+		/// \param buffer the buffer to describe. Its size must fit the size given to setSize().
+		/// \return true if the buffer was filled in
+		virtual bool acquireBuffer(const VideoPicture * /*picture*/, int /*type*/, VideoBuffer & /*buffer*/) { return false; }
+
+		/// Hands back a buffer given by acquireBuffer() once the picture has been written into it.
+		virtual void pushBuffer(const VideoBuffer & /*buffer*/, int /*type*/) {}
+
 		/// Informs the renderer of the encoded pixel aspect ratio.
 		virtual void setPixelAspectRatio(int /*aspectRatio*/) {}	// TODO replace with enum
 
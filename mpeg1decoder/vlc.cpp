@@ -534,16 +534,77 @@ namespace Mpeg1
 
 	bool Vlc::decodeDCTCoeff(InputBitstream *input, bool first, Vlc::RunLevel &runLevel)
 	{
-		int value = input->nextBits(17);
-		int index = (value >> 5) & 0xfff;
-
 		int run = 0;
-		int	level = 0;
+		int level = 0;
+		bool escape = false;
 
-		int discard = 0;
+		int discard = lookupDCTCoeff(input->nextBits(17), first, run, level, escape);
+		if (discard == 0)
+			return false;
+
+		input->getBits(discard);
+
+		if (escape) 
+		{
+			int r = input->getBits(6);
+			run   = r;
 
+			int l = input->nextBits(8);
+			if (l == 0 || l == 0x80) 
+			{
+				l = input->getSignedBits(16);
+			}
+			else 
+			{
+				l = input->getSignedBits(8);
+			}
+			level = l;
+		}
+
+		runLevel.setRun(run);
+		runLevel.setLevel(level);
+
+		return true;
+	}
+
+	/// Steps over a coefficient like decodeDCTCoeff() without working out its run and level
+	bool Vlc::skipDCTCoeff(InputBitstream *input, bool first)
+	{
+		int run = 0;
+		int level = 0;
 		bool escape = false;
 
+		int length = lookupDCTCoeff(input->nextBits(17), first, run, level, escape);
+		if (length == 0)
+			return false;
+
+		if (escape)
+		{
+			// The run is 6 bits, and the level 16 bits when its first 8 are 0 or 0x80, 8 otherwise
+			input->skipBits(length + 6);
+
+			int l = input->nextBits(8);
+			length = (l == 0 || l == 0x80) ? 16 : 8;
+		}
+
+		input->skipBits(length);
+		return true;
+	}
+
+	/// Looks up the code of a coefficient in the tables
+	///
+	/// \param value the next 17 bits of the bitstream
+	/// \param first true for dct_coeff_first
+	/// \param run receives the run
+	/// \param level receives the level, unless escape is set
+	/// \param escape set if the code is the escape code, followed by the run and level
+	/// \return the length of the code, or 0 if it is not valid
+	int Vlc::lookupDCTCoeff(int value, bool first, int &run, int &level, bool &escape)
+	{
+		int index = (value >> 5) & 0xfff;
+
+		int discard = 0;
+
 		if (index >= 0x1 && index <= 0xf) 
 		{
 			int offset = (index << 5);    // Multiply by 32, the size of each original array
@@ -706,32 +767,51 @@ namespace Mpeg1
 			}
 			else 
 			{
-				return false;
+				return 0;
 			}
 		}
 
-		input->getBits(discard);
+		return discard;
+	}
 
-		if (escape) 
-		{
-			int r = input->getBits(6);
-			run   = r;
+	// Written once the tables are read, so the reads can't be optimized away
+	static volatile int s_prefetchSink;
 
-			int l = input->nextBits(8);
-			if (l == 0 || l == 0x80) 
-			{
-				l = input->getSignedBits(16);
-			}
-			else 
-			{
-				l = input->getSignedBits(8);
-			}
-			level = l;
-		}
+	/// Reads one byte of each cache line of a table
+	static int touchTable(const void *table, int size)
+	{
+		const char *bytes = (const char *) table;
 
-		runLevel.setRun(run);
-		runLevel.setLevel(level);
+		int sum = 0;
+		for(int i = 0; i < size; i += 64)
+			sum += bytes[i];
 
-		return true;
+		return sum;
+	}
+
+	void Vlc::prefetchTables()
+	{
+		int sum = 0;
+
+		sum += touchTable(s_macroblockAddressIncrement, sizeof(s_macroblockAddressIncrement));
+		sum += touchTable(s_macroblockAddressIncrement1, sizeof(s_macroblockAddressIncrement1));
+		sum += touchTable(s_macroblockAddressIncrement2, sizeof(s_macroblockAddressIncrement2));
+		sum += touchTable(s_macroblockTypeI, sizeof(s_macroblockTypeI));
+		sum += touchTable(s_macroblockTypeP, sizeof(s_macroblockTypeP));
+		sum += touchTable(s_macroblockTypeB, sizeof(s_macroblockTypeB));
+		sum += touchTable(s_motionVector, sizeof(s_motionVector));
+		sum += touchTable(s_motionVector1, sizeof(s_motionVector1));
+		sum += touchTable(s_codedBlockPattern, sizeof(s_codedBlockPattern));
+		sum += touchTable(s_dctDcSizeLuminance, sizeof(s_dctDcSizeLuminance));
+		sum += touchTable(s_dctDcSizeLuminance1, sizeof(s_dctDcSizeLuminance1));
+		sum += touchTable(s_dctDcSizeChrominance, sizeof(s_dctDcSizeChrominance));
+		sum += touchTable(s_dctDcSizeChrominance1, sizeof(s_dctDcSizeChrominance1));
+		sum += touchTable(s_dctCoefficients, sizeof(s_dctCoefficients));
+		sum += touchTable(s_dctCoefficients1, sizeof(s_dctCoefficients1));
+		sum += touchTable(s_dctCoefficients2, sizeof(s_dctCoefficients2));
+		sum += touchTable(s_dctCoefficients3, sizeof(s_dctCoefficients3));
+		sum += touchTable(s_dctCoefficients4, sizeof(s_dctCoefficients4));
+
+		s_prefetchSink = sum;
 	}
 }
\ No newline at end of file
@@ -73,7 +73,15 @@ namespace Mpeg1
 
 		static bool decodeDCTCoeff(class InputBitstream *input, bool first, RunLevel &runLevel);
 
+		static bool skipDCTCoeff(class InputBitstream *input, bool first);
+
+		/// Reads through every table once, so decoding the first pictures doesn't take their page
+		/// faults and cache misses
+		static void prefetchTables();
+
 	private:
+		static int lookupDCTCoeff(int value, bool first, int &run, int &level, bool &escape);
+
 		static const short Vlc::s_macroblockAddressIncrement[];
 		static const short Vlc::s_macroblockAddressIncrement1[];
 		static const short Vlc::s_macroblockAddressIncrement2[];